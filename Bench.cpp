@@ -0,0 +1,258 @@
+/* ********************************************************************
+   * Project   : Microbenchmarks
+   * Author    : Simon Martin
+   * Copyright : LGPL v3
+   ********************************************************************
+
+    Modifications:
+    0.01 14/10/2026 Initial version.
+*/
+
+/*---------------------------------------------------------------------
+  -- compatibility
+  ---------------------------------------------------------------------*/
+
+/*---------------------------------------------------------------------
+  -- project includes (import)
+  ---------------------------------------------------------------------*/
+#include "CommandLine.h"
+#include "CommandRegistry.h"
+#include "Log.h"
+
+/*---------------------------------------------------------------------
+  -- project includes (export)
+  ---------------------------------------------------------------------*/
+
+/*---------------------------------------------------------------------
+  -- C standard includes
+  ---------------------------------------------------------------------*/
+
+/*---------------------------------------------------------------------
+  -- C++ standard includes
+  ---------------------------------------------------------------------*/
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstring>
+#include <format>
+#include <functional>
+#include <iostream>
+#include <limits>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/*---------------------------------------------------------------------
+  -- macros
+  ---------------------------------------------------------------------*/
+#define DEFAULT_ITERATIONS 100000
+#define DEFAULT_REPEATS 5
+
+/*---------------------------------------------------------------------
+  -- forward declarations
+  ---------------------------------------------------------------------*/
+
+/*---------------------------------------------------------------------
+  -- data types
+  ---------------------------------------------------------------------*/
+/**
+ * A benchmark: something to run once per iteration.
+ */
+struct Benchmark {
+  std::string_view name;
+  std::function<void()> body;
+};
+
+/*---------------------------------------------------------------------
+  -- function prototypes
+  ---------------------------------------------------------------------*/
+
+/*---------------------------------------------------------------------
+  -- global variables
+  ---------------------------------------------------------------------*/
+
+/*---------------------------------------------------------------------
+  -- local variables
+  ---------------------------------------------------------------------*/
+static volatile size_t sink; // Somewhere to put results so that the work is not optimised away
+
+// The benchmarks' own command line
+static constexpr std::array<CommandLineOptionSpec, 3> bench_options{{
+    {"iterations", 'i', false, HasValue::Required, Occurs::AtMost, 1, "Iterations of each benchmark per run. If not specified, then 100000.", CommandLineValueType::Integer(1, std::numeric_limits<int>::max())},
+    {"repeats", 'r', false, HasValue::Required, Occurs::AtMost, 1, "Runs of each benchmark, the fastest is reported. If not specified, then 5.", CommandLineValueType::Integer(1, std::numeric_limits<int>::max())},
+    {"filter", 'f', false, HasValue::Required, Occurs::AtMost, 1, "Only run the benchmarks whose name contains this."},
+}};
+using BenchCommandLine = StaticCommandLine<bench_options>;
+
+// The same shape as the server's own options
+static constexpr std::array<CommandLineOptionSpec, 12> server_options{{
+    {"host", 'h', false, HasValue::Required, Occurs::AtMost, 1, "IP host address to bind to."},
+    {"port", 'p', false, HasValue::Required, Occurs::AtMost, 1, "TCP port to bind to.", CommandLineValueType::Port()},
+    {"idle-timeout", 't', false, HasValue::Required, Occurs::AtMost, 1, "Seconds without input before a connection is closed.", CommandLineValueType::Duration(std::chrono::seconds{1}, std::chrono::seconds{1})},
+    {"no-echo", 'n', false, HasValue::No, Occurs::AtMost, 1, "Do not echo the characters received back to the client."},
+    {"recv-buffer", 'B', false, HasValue::Required, Occurs::AtMost, 1, "Size in bytes of the buffer that data is received into.", CommandLineValueType::Integer(1, std::numeric_limits<int>::max())},
+    {"max-line", 'l', false, HasValue::Required, Occurs::AtMost, 1, "Longest line in characters that a client may send.", CommandLineValueType::Integer(1, std::numeric_limits<int>::max())},
+    {"backlog", 'b', false, HasValue::Required, Occurs::AtMost, 1, "Length of the queue of connections waiting to be accepted.", CommandLineValueType::Integer(1, std::numeric_limits<int>::max())},
+    {"max-connections", 'm', false, HasValue::Required, Occurs::AtMost, 1, "Maximum number of connections at the same time.", CommandLineValueType::Integer(1, std::numeric_limits<int>::max())},
+    {"log-async", 'a', false, HasValue::No, Occurs::AtMost, 1, "Write the log from a background thread."},
+    {"log-level", '\0', false, HasValue::Required, Occurs::AtMost, 1, "Least important log records that are written."},
+    {"reactors", 'r', false, HasValue::Required, Occurs::AtMost, 1, "Number of event loop threads.", CommandLineValueType::Integer(1, std::numeric_limits<int>::max())},
+    {"workers", 'w', false, HasValue::Required, Occurs::AtMost, 1, "Number of threads serving connections.", CommandLineValueType::Integer(1, std::numeric_limits<int>::max())},
+}};
+using ServerCommandLine = StaticCommandLine<server_options>;
+
+/*---------------------------------------------------------------------
+  -- private functions
+  ---------------------------------------------------------------------*/
+static void run_benchmark(const Benchmark &benchmark, int iterations, int repeats) {
+  // Warm up, then keep the best run as the least disturbed by everything else
+  for (int i = 0; i < std::max(iterations / 10, 1); i++) {
+    benchmark.body();
+  }
+  double best = 0;
+  for (int repeat = 0; repeat < repeats; repeat++) {
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < iterations; i++) {
+      benchmark.body();
+    }
+    double elapsed = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / iterations;
+    best = repeat ? std::min(best, elapsed) : elapsed;
+  }
+
+  std::string_view name = benchmark.name;
+  double per_second = 1e9 / best;
+  std::cout << std::format("{0:<24} {1:>12.1f} ns/op {2:>14.0f} op/s", name, best, per_second) << std::endl;
+}
+
+/*---------------------------------------------------------------------
+  -- public functions
+  ---------------------------------------------------------------------*/
+
+int main(int argc, char *argv[]) {
+  // Get the parameters
+  BenchCommandLine cmd_run;
+  if (std::stringstream error_message; !cmd_run.Parse(argc, argv, error_message)) {
+    std::cerr << error_message.str() << std::endl;
+    cmd_run.PrintUsage(argv);
+    return 1;
+  }
+  int iterations = DEFAULT_ITERATIONS;
+  cmd_run.GetOptionValue<BenchCommandLine::IndexOf("iterations")>(iterations);
+  int repeats = DEFAULT_REPEATS;
+  cmd_run.GetOptionValue<BenchCommandLine::IndexOf("repeats")>(repeats);
+  std::string_view filter;
+  cmd_run.GetOptionValue<BenchCommandLine::IndexOf("filter")>(filter);
+
+  // A typical server command line, parsed again and again by the one compiled parser
+  CommandLine parser{server_options};
+  parser.Compile();
+  CommandLine native_parser{parser};
+  native_parser.SetScanner(CommandLineScanner::Native);
+  CommandLine views_parser{native_parser};
+  views_parser.SetCopyValues(false);
+  ServerCommandLine static_parser;
+  std::array<const char *, 10> server_argv{"cli", "-p", "8023", "--idle-timeout", "30", "-n", "--reactors", "4", "--log-level", "warn"};
+  std::vector<char *> parse_argv(server_argv.size());
+  std::ranges::transform(server_argv, parse_argv.begin(), [](const char *arg) { return const_cast<char *>(arg); });
+  if (std::stringstream error_message; !views_parser.Parse(static_cast<int>(parse_argv.size()), parse_argv.data(), error_message) || !static_parser.Parse(static_cast<int>(parse_argv.size()), parse_argv.data(), error_message)) {
+    std::cerr << error_message.str() << std::endl;
+    return 1;
+  }
+
+  // The commands, run the way that connection_command runs them, into a reused output buffer
+  CommandRegistry commands;
+  commands.Add("EX", "Stop the server.", [](CommandArguments, CommandOutput &) {});
+  commands.Add("DIR", "List the directory.", [](CommandArguments, CommandOutput &out) { out += "Directory...\n"; });
+  commands.Add("STATS", "Show the server statistics.", [](CommandArguments args, CommandOutput &out) { out.append(args.size(), '.'); });
+  commands.Freeze();
+  CommandOutput output;
+
+  // Records are formatted and written in full, but thrown away
+  if (!log_open(LogFormat::Text, "/dev/null", false)) {
+    std::cerr << "Error: failed to open /dev/null" << std::endl;
+    return 1;
+  }
+  int value = 42;
+  std::string_view text = "text";
+
+  std::vector<Benchmark> benchmarks{
+    {"commandline_parse", [&] {
+      std::stringstream error_message;
+      sink = parser.Parse(static_cast<int>(parse_argv.size()), parse_argv.data(), error_message);
+    }},
+    {"commandline_parse_native", [&] {
+      std::stringstream error_message;
+      sink = native_parser.Parse(static_cast<int>(parse_argv.size()), parse_argv.data(), error_message);
+    }},
+    {"commandline_parse_views", [&] {
+      std::stringstream error_message;
+      sink = views_parser.Parse(static_cast<int>(parse_argv.size()), parse_argv.data(), error_message);
+    }},
+    {"commandline_parse_static", [&] {
+      std::stringstream error_message;
+      sink = static_parser.Parse(static_cast<int>(parse_argv.size()), parse_argv.data(), error_message);
+    }},
+    {"commandline_lookup", [&] {
+      sink = parser.IsOptionValue("workers") + parser.IsOptionValue('p') + parser.GetOptionValues("log-level").size();
+    }},
+    {"commandline_typed", [&] {
+      int port = 0;
+      std::chrono::seconds idle_timeout{0};
+      sink = views_parser.GetOptionValue("port", port) + views_parser.GetOptionValue("idle-timeout", idle_timeout) + port + idle_timeout.count();
+    }},
+    {"commandline_typed_static", [&] {
+      int port = 0;
+      std::chrono::seconds idle_timeout{0};
+      sink = static_parser.GetOptionValue<ServerCommandLine::IndexOf("port")>(port) + static_parser.GetOptionValue<ServerCommandLine::IndexOf("idle-timeout")>(idle_timeout) + port + idle_timeout.count();
+    }},
+    {"command_execute", [&] {
+      output.clear();
+      commands.Execute("DIR", output);
+      sink = output.size();
+    }},
+    {"command_execute_args", [&] {
+      output.clear();
+      commands.Execute("stats one two \"three four\" five", output);
+      sink = output.size();
+    }},
+    {"command_unknown", [&] {
+      output.clear();
+      sink = commands.Execute("NOPE", output) != nullptr;
+    }},
+    {"write_log", [&] {
+      WRITE_LOG("Benchmark {0} {1}", value, text);
+    }},
+    {"write_log_json", [&] {
+      WRITE_LOG("Benchmark {0} \"{1}\"", value, text);
+    }},
+    {"write_log_disabled", [&] {
+      WRITE_LOG_DEBUG("Benchmark {0} {1}", value, text);
+    }},
+    {"write_log_async", [&] {
+      WRITE_LOG("Benchmark {0} {1}", value, text);
+    }},
+  };
+
+  for (const auto &benchmark : benchmarks) {
+    if (!filter.empty() && benchmark.name.find(filter) == std::string_view::npos) {
+      continue;
+    }
+
+    // Some of the logging benchmarks need the logger set up for them
+    if (benchmark.name == "write_log_json") {
+      log_open(LogFormat::Json, "/dev/null", false);
+    }
+    if (benchmark.name == "write_log_async") {
+      log_open(LogFormat::Text, "/dev/null", false);
+      log_start_async(DEFAULT_LOG_RING, LogOverflow::Block);
+    }
+    run_benchmark(benchmark, iterations, repeats);
+    if (benchmark.name == "write_log_json") {
+      log_open(LogFormat::Text, "/dev/null", false);
+    }
+  }
+
+  log_stop();
+  return 0;
+}
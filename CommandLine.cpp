@@ -24,19 +24,42 @@
 /*---------------------------------------------------------------------
   -- C standard includes
   ---------------------------------------------------------------------*/
-#include <getopt.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#ifdef _MSC_VER
+#include <io.h>
+#include <ws2tcpip.h>
+#else
+#include <arpa/inet.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
 
 /*---------------------------------------------------------------------
   -- C++ standard includes
   ---------------------------------------------------------------------*/
 #include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <cmath>
 #include <iostream>
+#include <cstdlib>
 #include <cstring>
 #include <ranges>
+#include <utility>
 
 /*---------------------------------------------------------------------
   -- macros
   ---------------------------------------------------------------------*/
+// getopt_long_r returns this plus the option's position for long options, clear of every short name
+#define LONG_OPTION_BASE 256
+
+// How deep response files can name response files, so that one naming itself is reported, not followed for ever
+#define MAX_RESPONSE_FILE_DEPTH 16
+
+// How much more of a response file that cannot be mapped is read at a time
+#define RESPONSE_FILE_READ_SIZE 65536
 
 /*---------------------------------------------------------------------
   -- forward declarations
@@ -45,6 +68,82 @@
 /*---------------------------------------------------------------------
   -- data types
   ---------------------------------------------------------------------*/
+/**
+ * A long option as getopt_long_r sees it.
+ */
+struct CommandLineLongOption
+{
+    std::string name;
+    HasValue has_value;
+    int val; // Returned when the option is found
+};
+
+/**
+ * What getopt_long_r needs to parse a command line. Built once by Compile and never changed after that.
+ */
+struct CommandLineTables
+{
+    std::string short_opts;
+    std::vector<CommandLineLongOption> long_opts; // Sorted by name, so that abbreviations are next to each other
+    bool require_order; // Stop at the first operand, as POSIXLY_CORRECT asks, rather than looking past it
+    std::string usage;  // The options described UsageWidth wide, for GetUsage and PrintUsage
+};
+
+/**
+ * A file mapped into memory, privately, so that its arguments can be split where they are. It is mapped
+ * over one more byte than it has, so the last argument has somewhere to be terminated. A file that cannot
+ * be mapped, such as a pipe, or any file where there is no mmap, is read into text instead, with the spare
+ * byte after it.
+ */
+struct CommandLineFile
+{
+#ifndef _MSC_VER
+    void *base{MAP_FAILED};
+    size_t length{0};
+#endif
+    std::vector<char> text;
+
+    CommandLineFile() = default;
+    CommandLineFile(const CommandLineFile &) = delete;
+    CommandLineFile &operator=(const CommandLineFile &) = delete;
+#ifndef _MSC_VER
+    ~CommandLineFile()
+    {
+        if (base != MAP_FAILED)
+        {
+            munmap(base, length);
+        }
+    }
+#endif
+};
+
+/**
+ * Finds the options of a CommandLine for Scan and ScanDefaults, through the tables built by Compile.
+ */
+struct CommandLine::Lookup
+{
+    CommandLine &parser;
+
+    size_t FindShort(char name) const { return parser.short_index[static_cast<unsigned char>(name)]; }
+    size_t FindLong(std::string_view name) const;
+    HasValue GetHasValue(size_t index) const { return parser.options[index].has_value; }
+    std::string_view GetLongName(size_t index) const { return parser.options[index].long_name; }
+    const CommandLineOptionState &GetState(size_t index) const { return parser.options[index]; }
+    void Store(size_t index, const char *value) { parser.options[index].Store(value, parser.copy_values); }
+};
+
+/**
+ * How far getopt_long_r has got through a command line. It takes the place of getopt's globals, so each
+ * parse has its own and any number can run at once.
+ */
+struct GetoptState
+{
+    int optind{1};          // Next element of argv to scan
+    char *optarg{nullptr};  // Value of the option just returned, if it has one
+    char *nextchar{nullptr}; // Rest of the current element of short options, nullptr to move on to the next
+    int first_nonopt{1};    // The operands skipped so far, which are moved after the options
+    int last_nonopt{1};
+};
 
 /*---------------------------------------------------------------------
   -- function prototypes
@@ -58,23 +157,777 @@
   -- local variables
   ---------------------------------------------------------------------*/
 static const std::vector<std::string> empty{ "" };
+static const CommandLineValueViews empty_views;
+
+// The suffixes of a duration, longest first so that ms is not taken for m
+static const std::array<std::pair<std::string_view, std::chrono::nanoseconds>, 6> duration_units{ {
+    { "ns", std::chrono::nanoseconds{1} },
+    { "us", std::chrono::microseconds{1} },
+    { "ms", std::chrono::milliseconds{1} },
+    { "s", std::chrono::seconds{1} },
+    { "m", std::chrono::minutes{1} },
+    { "h", std::chrono::hours{1} },
+} };
 
 /*---------------------------------------------------------------------
   -- private functions
   ---------------------------------------------------------------------*/
+static void getopt_exchange(char **argv, GetoptState &state)
+{
+    // Move the options scanned since the skipped operands in front of them, keeping both in order
+    std::rotate(argv + state.first_nonopt, argv + state.last_nonopt, argv + state.optind);
+    state.first_nonopt += state.optind - state.last_nonopt;
+    state.last_nonopt = state.optind;
+}
+
+/**
+ * Convert the text of a value to its type, and check that it is in range.
+ *
+ * @param type  What the value must be.
+ * @param text  The value as it was given.
+ * @param value Where the converted value goes.
+ * @return      False if the text is not a value of the type.
+ */
+static bool convert_value(const CommandLineValueType &type, std::string_view text, CommandLineValue &value)
+{
+    const char *begin = text.data();
+    const char *end = text.data() + text.size();
+    switch (type.type)
+    {
+    case ValueType::Text:
+        return true;
+    case ValueType::Integer:
+    {
+        auto [last, error] = std::from_chars(begin, end, value.integer);
+        return error == std::errc{} && last == end && value.integer >= type.minimum && value.integer <= type.maximum;
+    }
+    case ValueType::Float:
+    {
+        auto [last, error] = std::from_chars(begin, end, value.real);
+        return error == std::errc{} && last == end && value.real >= type.real_minimum && value.real <= type.real_maximum;
+    }
+    case ValueType::Enum:
+    {
+        auto name = std::ranges::find(type.names, text, &CommandLineEnumName::name);
+        if (name == type.names.end())
+        {
+            return false;
+        }
+        value.integer = name->value;
+        return true;
+    }
+    case ValueType::Duration:
+    {
+        // A number, which may have a fraction, and then its unit
+        double number = 0;
+        auto [last, error] = std::from_chars(begin, end, number, std::chars_format::fixed);
+        if (error != std::errc{} || last == begin)
+        {
+            return false;
+        }
+        std::chrono::nanoseconds unit = type.unit;
+        if (std::string_view suffix{last, end}; !suffix.empty())
+        {
+            auto i = std::ranges::find(duration_units, suffix, &std::pair<std::string_view, std::chrono::nanoseconds>::first);
+            if (i == duration_units.end())
+            {
+                return false;
+            }
+            unit = i->second;
+        }
+        double nanoseconds = std::round(number * static_cast<double>(unit.count()));
+        // INT64_MAX is rounded up to 2^63 as a double, so the bound on the conversion has to be a strict one
+        if (!(nanoseconds >= static_cast<double>(type.minimum) && nanoseconds <= static_cast<double>(type.maximum) && nanoseconds < static_cast<double>(std::numeric_limits<int64_t>::max())))
+        {
+            return false;
+        }
+        value.integer = std::clamp(static_cast<int64_t>(nanoseconds), type.minimum, type.maximum);
+        return true;
+    }
+    case ValueType::Address:
+    {
+        // inet_pton needs the text to end
+        std::string address{text};
+        if (inet_pton(AF_INET, address.c_str(), value.address.bytes.data()) == 1)
+        {
+            value.address.size = 4;
+            return true;
+        }
+        if (inet_pton(AF_INET6, address.c_str(), value.address.bytes.data()) == 1)
+        {
+            value.address.size = 16;
+            return true;
+        }
+        return false;
+    }
+    }
+    return false;
+}
+
+/**
+ * Write a duration in the largest unit that it is a whole number of.
+ *
+ * @param out      Where it is written.
+ * @param duration The duration.
+ */
+static void describe_duration(std::ostream &out, std::chrono::nanoseconds duration)
+{
+    for (auto i = duration_units.rbegin(); i != duration_units.rend(); ++i)
+    {
+        if (duration.count() % i->second.count() == 0)
+        {
+            out << duration.count() / i->second.count() << i->first;
+            return;
+        }
+    }
+}
+
+/**
+ * Say what a value of a type must be, to finish "must be".
+ *
+ * @param out  Where it is written.
+ * @param type The type.
+ */
+static void describe_type(std::ostream &out, const CommandLineValueType &type)
+{
+    switch (type.type)
+    {
+    case ValueType::Text:
+        out << "text";
+        break;
+    case ValueType::Integer:
+        out << "a whole number";
+        if (type.minimum != std::numeric_limits<int64_t>::min() && type.maximum != std::numeric_limits<int64_t>::max())
+        {
+            out << " from " << type.minimum << " to " << type.maximum;
+        }
+        else if (type.minimum != std::numeric_limits<int64_t>::min())
+        {
+            out << " of at least " << type.minimum;
+        }
+        else if (type.maximum != std::numeric_limits<int64_t>::max())
+        {
+            out << " of at most " << type.maximum;
+        }
+        break;
+    case ValueType::Float:
+        out << "a number";
+        if (std::isfinite(type.real_minimum) && std::isfinite(type.real_maximum))
+        {
+            out << " from " << type.real_minimum << " to " << type.real_maximum;
+        }
+        else if (std::isfinite(type.real_minimum))
+        {
+            out << " of at least " << type.real_minimum;
+        }
+        else if (std::isfinite(type.real_maximum))
+        {
+            out << " of at most " << type.real_maximum;
+        }
+        break;
+    case ValueType::Enum:
+        out << "one of";
+        for (size_t i = 0; i < type.names.size(); i++)
+        {
+            out << (i ? ", " : " ") << type.names[i].name;
+        }
+        break;
+    case ValueType::Duration:
+        // Not suggesting a fraction of a second where it is below the minimum
+        out << (type.minimum < std::chrono::nanoseconds{std::chrono::seconds{1}}.count() ? "a duration, such as 500ms, 30s or 2m" : "a duration, such as 30s or 2m");
+        if (type.maximum != std::numeric_limits<int64_t>::max())
+        {
+            out << ", from ";
+            describe_duration(out, std::chrono::nanoseconds{type.minimum});
+            out << " to ";
+            describe_duration(out, std::chrono::nanoseconds{type.maximum});
+        }
+        else if (type.minimum)
+        {
+            out << ", of at least ";
+            describe_duration(out, std::chrono::nanoseconds{type.minimum});
+        }
+        break;
+    case ValueType::Address:
+        out << "an IPv4 or IPv6 address";
+        break;
+    }
+}
+
+/**
+ * Split the text of a response file into its arguments, as a shell would split a line. They are separated by
+ * white space, quoted with ' or ", and a \ outside single quotes takes the character after it as it is. A #
+ * at the start of an argument comments out the rest of the line.
+ *
+ * @param p      The text, which is written over as the arguments are unquoted and terminated.
+ * @param end    The end of the text, with a spare byte there that can be written to.
+ * @param tokens Where the arguments are added, pointing into the text.
+ */
+static void split_arguments(char *p, char *end, std::vector<char *> &tokens)
+{
+    while (true)
+    {
+        // Arguments are separated by white space, and a comment runs to the end of the line
+        while (p < end && std::isspace(static_cast<unsigned char>(*p)))
+        {
+            p++;
+        }
+        if (p == end)
+        {
+            break;
+        }
+        if (*p == '#')
+        {
+            while (p < end && *p != '\n')
+            {
+                p++;
+            }
+            continue;
+        }
+
+        // The argument is written back over itself without its quotes and escapes, so it only gets shorter
+        char *token = p;
+        char *out = p;
+        char quote = '\0';
+        while (p < end && (quote || !std::isspace(static_cast<unsigned char>(*p))))
+        {
+            char c = *p++;
+            if (c == quote)
+            {
+                quote = '\0';
+            }
+            else if (!quote && (c == '"' || c == '\''))
+            {
+                quote = c;
+            }
+            else if (c == '\\' && quote != '\'' && p < end)
+            {
+                *out++ = *p++;
+            }
+            else
+            {
+                *out++ = c;
+            }
+        }
+
+        // Terminated over the white space after it, or the spare byte past the end
+        *out = '\0';
+        if (p < end)
+        {
+            p++;
+        }
+        tokens.push_back(token);
+    }
+}
+
+/**
+ * Read a file that cannot be mapped to its end.
+ *
+ * @param fd   The file.
+ * @param text Where to put what it has, followed by a spare byte.
+ * @return     True if it was read, false if not, with errno saying why.
+ */
+static bool read_arguments(int fd, std::vector<char> &text)
+{
+    size_t size = 0;
+    while (true)
+    {
+        // Room for the next part and the spare byte, cut back to what was read when it ends
+        text.resize(size + RESPONSE_FILE_READ_SIZE + 1);
+        auto count = read(fd, text.data() + size, RESPONSE_FILE_READ_SIZE);
+        if (count < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            return false;
+        }
+        if (!count)
+        {
+            text.resize(size + 1);
+            return true;
+        }
+        size += static_cast<size_t>(count);
+    }
+}
+
+/**
+ * Get the arguments of a response file, mapping it where it can and reading it where it cannot.
+ *
+ * @param path          The file.
+ * @param tokens        Where the arguments are added, pointing into the file that is returned.
+ * @param error_message Where to report why the file cannot be had.
+ * @return              The file, which the arguments live in, or nullptr if it cannot be had.
+ */
+static std::shared_ptr<const CommandLineFile> map_arguments(const char *path, std::vector<char *> &tokens, std::stringstream &error_message)
+{
+#ifdef _MSC_VER
+    int fd = open(path, O_RDONLY);
+#else
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+#endif
+    if (fd < 0)
+    {
+        error_message << "Error: failed to open " << path << ": " << strerror(errno) << std::endl;
+        return nullptr;
+    }
+    auto file = std::make_shared<CommandLineFile>();
+    char *begin = nullptr;
+    size_t size = 0;
+#ifndef _MSC_VER
+    struct stat status{};
+    if (fstat(fd, &status) < 0)
+    {
+        error_message << "Error: failed to read " << path << ": " << strerror(errno) << std::endl;
+        close(fd);
+        return nullptr;
+    }
+
+    // Only a regular file has a size to map. Anything else, such as a pipe or <(...), is read to its end
+    if (S_ISREG(status.st_mode))
+    {
+        // Anonymous memory for the spare byte, with the file mapped over the front of it. The pages are
+        // private, so splitting the arguments copies the ones that it writes to, never the file
+        size = static_cast<size_t>(status.st_size);
+        file->length = size + 1;
+        file->base = mmap(nullptr, file->length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANON, -1, 0);
+        if (file->base == MAP_FAILED || (size && mmap(file->base, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED, fd, 0) == MAP_FAILED))
+        {
+            error_message << "Error: failed to map " << path << ": " << strerror(errno) << std::endl;
+            close(fd);
+            return nullptr;
+        }
+        begin = static_cast<char *>(file->base);
+    }
+#endif
+    if (!begin)
+    {
+        if (!read_arguments(fd, file->text))
+        {
+            error_message << "Error: failed to read " << path << ": " << strerror(errno) << std::endl;
+            close(fd);
+            return nullptr;
+        }
+        begin = file->text.data();
+        size = file->text.size() - 1;
+    }
+    close(fd);
+
+    split_arguments(begin, begin + size, tokens);
+    return file;
+}
+
+/**
+ * Describe options that were added at run time, the same way AppendUsage describes those of a StaticCommandLine.
+ *
+ * @param out     Where the description is added.
+ * @param options The options.
+ * @param width   How wide the lines can be.
+ */
+static void append_usage(std::string &out, const std::vector<CommandLineOption> &options, size_t width)
+{
+    // Described as the options that they were added as, pointing at their strings
+    std::vector<CommandLineOptionSpec> specs;
+    specs.reserve(options.size());
+    for (const auto &option : options)
+    {
+        specs.push_back({ .long_name = option.long_name, .short_name = option.short_name, .required = option.required, .has_value = option.has_value, .occurs_type = option.occurs_type, .occurs_value = option.occurs_value, .help = option.help, .type = option.type });
+    }
+    CommandLine::AppendUsage(out, specs, width);
+}
+
+/**
+ * Find a long option by its name, or by an abbreviation of it that no other name starts with.
+ *
+ * @param tables The options.
+ * @param name   What was typed.
+ * @return       The option, or nullptr if there is none or the abbreviation could be more than one.
+ */
+static const CommandLineLongOption *find_long_option(const CommandLineTables &tables, std::string_view name)
+{
+    // Every name that starts with what was typed follows the place where it would go
+    auto i = std::ranges::lower_bound(tables.long_opts, name, std::ranges::less{}, &CommandLineLongOption::name);
+    if (i == tables.long_opts.end() || !i->name.starts_with(name))
+    {
+        return nullptr;
+    }
+    if (i->name.size() == name.size())
+    {
+        return &*i;
+    }
+    auto next = i + 1;
+    return next != tables.long_opts.end() && next->name.starts_with(name) ? nullptr : &*i;
+}
+
+/**
+ * The GNU getopt_long algorithm, with its state passed in rather than held in globals, and without
+ * its error messages. Options and operands may be mixed, long names may be abbreviated as long as they
+ * stay unique and "--" ends the options.
+ *
+ * @param argc   Number of parameters.
+ * @param argv   Parameter array, which is reordered so that the options come before the operands.
+ * @param tables The options.
+ * @param state  Where the scan has got to, set up for the first call and then passed on to the next.
+ * @return       The next option's name, or LONG_OPTION_BASE plus its position for a long one, '?' for
+ *               an unknown option or a missing value, and -1 when there are none left.
+ */
+static int getopt_long_r(int argc, char **argv, const CommandLineTables &tables, GetoptState &state)
+{
+    auto is_operand = [argv, &state] { return argv[state.optind][0] != '-' || argv[state.optind][1] == '\0'; };
+    state.optarg = nullptr;
+
+    if (!state.nextchar || !*state.nextchar)
+    {
+        // Skip the operands, once the options that followed the last ones have been put in front of them
+        if (!tables.require_order)
+        {
+            if (state.first_nonopt != state.last_nonopt && state.last_nonopt != state.optind)
+            {
+                getopt_exchange(argv, state);
+            }
+            else if (state.last_nonopt != state.optind)
+            {
+                state.first_nonopt = state.optind;
+            }
+            while (state.optind < argc && is_operand())
+            {
+                state.optind++;
+            }
+            state.last_nonopt = state.optind;
+        }
+
+        // Everything after "--" is an operand
+        if (state.optind != argc && !strcmp(argv[state.optind], "--"))
+        {
+            state.optind++;
+            if (state.first_nonopt != state.last_nonopt && state.last_nonopt != state.optind)
+            {
+                getopt_exchange(argv, state);
+            }
+            else if (state.first_nonopt == state.last_nonopt)
+            {
+                state.first_nonopt = state.optind;
+            }
+            state.last_nonopt = argc;
+            state.optind = argc;
+        }
+
+        // Done, leave optind at the operands
+        if (state.optind == argc)
+        {
+            if (state.first_nonopt != state.last_nonopt)
+            {
+                state.optind = state.first_nonopt;
+            }
+            return -1;
+        }
+
+        // Only get here with an operand when the options must come first
+        if (is_operand())
+        {
+            return -1;
+        }
+
+        // Skip the dashes
+        state.nextchar = argv[state.optind] + 1 + (argv[state.optind][1] == '-');
+    }
+
+    // A long option, matched exactly or by an abbreviation that only fits one name
+    if (argv[state.optind][1] == '-')
+    {
+        char *nameend = state.nextchar + strcspn(state.nextchar, "=");
+        std::string_view name{state.nextchar, static_cast<size_t>(nameend - state.nextchar)};
+        const CommandLineLongOption *found = nullptr;
+        bool exact = false;
+        bool ambiguous = false;
+        for (const auto &long_opt : tables.long_opts)
+        {
+            if (!long_opt.name.starts_with(name))
+            {
+                continue;
+            }
+            if (long_opt.name.size() == name.size())
+            {
+                found = &long_opt;
+                exact = true;
+                break;
+            }
+            if (found)
+            {
+                ambiguous = true;
+            }
+            else
+            {
+                found = &long_opt;
+            }
+        }
+
+        state.optind++;
+        state.nextchar = nullptr;
+        if ((ambiguous && !exact) || !found)
+        {
+            return '?';
+        }
+        if (*nameend)
+        {
+            // The value is given with =, so the option had better take one
+            if (found->has_value == HasValue::No)
+            {
+                return '?';
+            }
+            state.optarg = nameend + 1;
+        }
+        else if (found->has_value == HasValue::Required)
+        {
+            // The value is the next element
+            if (state.optind == argc)
+            {
+                return '?';
+            }
+            state.optarg = argv[state.optind++];
+        }
+        return found->val;
+    }
+
+    // A short option, which may be followed by more of them in the same element
+    char c = *state.nextchar++;
+    const char *spec = c == ':' ? nullptr : strchr(tables.short_opts.c_str(), c);
+    if (*state.nextchar == '\0')
+    {
+        state.optind++;
+    }
+    if (!spec)
+    {
+        return '?';
+    }
+    if (spec[1] == ':')
+    {
+        if (*state.nextchar != '\0')
+        {
+            // The rest of the element is the value
+            state.optarg = state.nextchar;
+            state.optind++;
+        }
+        else if (spec[2] != ':')
+        {
+            // A value that must be given is the next element
+            if (state.optind == argc)
+            {
+                c = '?';
+            }
+            else
+            {
+                state.optarg = argv[state.optind++];
+            }
+        }
+        state.nextchar = nullptr;
+    }
+    return c;
+}
 
 /*---------------------------------------------------------------------
   -- public functions
   ---------------------------------------------------------------------*/
 
+bool CommandLineOptionState::Validate(std::string_view long_name, bool required, Occurs occurs_type, int occurs_value, const CommandLineValueType &type, std::stringstream &error_message)
+{
+    // If this option is not present then let's see if we need it.
+    if (!count)
+    {
+        // If this option is required then we fail.
+        if (required)
+        {
+            error_message << "Error: option " << long_name << " is required" << std::endl;
+            return false;
+        }
+
+        // We're done
+        return true;
+    }
+
+    // This option is here so let's validate the occurrences.
+    bool rc = true;
+    switch (occurs_type)
+    {
+    case Occurs::AtLeast:
+        if (count < occurs_value)
+        {
+            error_message << "Error: option " << long_name << " must occur at least " << occurs_value << " time(s)" << std::endl;
+            rc = false;
+        }
+        break;
+    case Occurs::AtMost:
+        if (count > occurs_value)
+        {
+            error_message << "Error: option " << long_name << " must occur at most " << occurs_value << " time(s)" << std::endl;
+            rc = false;
+        }
+        break;
+    case Occurs::Exactly:
+        if (count != occurs_value)
+        {
+            error_message << "Error: option " << long_name << " must occur exactly " << occurs_value << " time(s)" << std::endl;
+            rc = false;
+        }
+        break;
+    }
+
+    // Convert the values, once, so that reading them is just a copy
+    if (type.type == ValueType::Text)
+    {
+        return rc;
+    }
+    for (size_t i = 0; i < views.Size(); i++)
+    {
+        CommandLineValue result{};
+        if (!convert_value(type, views[i], result))
+        {
+            error_message << "Error: option " << long_name << " must be ";
+            describe_type(error_message, type);
+            error_message << ", not " << views[i] << std::endl;
+            rc = false;
+        }
+        converted.Add(result);
+    }
+
+    return rc;
+}
+
+size_t CommandLine::Lookup::FindLong(std::string_view name) const
+{
+    const CommandLineLongOption *long_opt = find_long_option(*parser.tables, name);
+    return long_opt ? static_cast<size_t>(long_opt->val - LONG_OPTION_BASE) : NoOption;
+}
+
+bool CommandLineArguments::Include(const char *path, int depth, std::stringstream &error_message)
+{
+    if (depth >= MAX_RESPONSE_FILE_DEPTH)
+    {
+        error_message << "Error: response files nested too deeply at " << path << std::endl;
+        return false;
+    }
+
+    // The file's arguments go in where it was named, with the response files that they name read in too
+    std::vector<char *> tokens;
+    auto file = map_arguments(path, tokens, error_message);
+    if (!file)
+    {
+        return false;
+    }
+    files.push_back(std::move(file));
+    bool rc = true;
+    for (char *token : tokens)
+    {
+        if (token[0] == '@' && token[1] == '@')
+        {
+            arguments.push_back(token + 1);
+        }
+        else if (token[0] == '@' && token[1])
+        {
+            rc = Include(token + 1, depth + 1, error_message) && rc;
+        }
+        else
+        {
+            arguments.push_back(token);
+        }
+    }
+    return rc;
+}
+
+void CommandLineArguments::Clear()
+{
+    arguments.clear();
+    files.clear();
+}
+
+bool CommandLineArguments::Expand(int argc, char * argv[], std::stringstream &error_message)
+{
+    Clear();
+    bool rc = true;
+    for (int i = 0; i < argc; i++)
+    {
+        // The program name is never a response file, and neither is a lone @. A leading @@ stands for a @
+        if (i && argv[i][0] == '@' && argv[i][1] == '@')
+        {
+            arguments.push_back(argv[i] + 1);
+        }
+        else if (i && argv[i][0] == '@' && argv[i][1])
+        {
+            rc = Include(argv[i] + 1, 0, error_message) && rc;
+        }
+        else
+        {
+            arguments.push_back(argv[i]);
+        }
+    }
+    return rc;
+}
+
+bool CommandLineArguments::Read(std::string_view path, std::stringstream &error_message)
+{
+    static char program[] = "";
+    if (arguments.empty())
+    {
+        arguments.push_back(program);
+    }
+    return Include(std::string{path}.c_str(), 0, error_message);
+}
+
+CommandLine::CommandLine()
+{
+    Clean();
+}
+
 CommandLine::CommandLine(const std::vector<CommandLineOption> &options)
 {
+    Clean();
     this->options = options;
+    for (size_t i = 0; i < this->options.size(); i++)
+    {
+        IndexOption(i);
+    }
+}
+
+CommandLine::CommandLine(std::span<const CommandLineOptionSpec> options)
+{
+    Clean();
+    for (const auto &option : options)
+    {
+        AddOption(option.long_name, option.short_name, option.required, option.has_value, option.occurs_type, option.occurs_value, option.help, option.type);
+    }
 }
 
-void CommandLine::AddOption(const std::string_view &long_name, char short_name, bool required, HasValue has_value, Occurs occurs_type, int occurs_value, const std::string_view &help)
+void CommandLine::Clean()
 {
-    CommandLineOption option;
+    options.clear();
+    short_index.fill(NoOption);
+    long_index.clear();
+    tables.reset();
+}
+
+void CommandLine::IndexOption(size_t index)
+{
+    const CommandLineOption &option = options[index];
+    if (option.short_name && short_index[static_cast<unsigned char>(option.short_name)] == NoOption)
+    {
+        short_index[static_cast<unsigned char>(option.short_name)] = index;
+    }
+    if (!option.long_name.empty())
+    {
+        long_index.try_emplace(option.long_name, index);
+    }
+}
+
+bool CommandLine::AddOption(const std::string_view &long_name, char short_name, bool required, HasValue has_value, Occurs occurs_type, int occurs_value, const std::string_view &help, const CommandLineValueType &type)
+{
+    // The tables have been built from the options that there were
+    if (tables)
+    {
+        return false;
+    }
+
+    CommandLineOption option{};
 
     option.long_name = long_name;
     option.short_name = short_name;
@@ -83,79 +936,78 @@ void CommandLine::AddOption(const std::string_view &long_name, char short_name,
     option.occurs_type = occurs_type;
     option.occurs_value = occurs_value;
     option.help = help;
+    option.type = type;
 
     options.push_back(option);
+    IndexOption(options.size() - 1);
+    return true;
 }
 
-void CommandLine::BuildParserParameters(std::string &short_opts, std::vector<struct option> &long_opts)
+void CommandLine::Compile()
 {
-    // Build the options
-    for (auto i = options.begin(); i != options.end(); ++i)
+    if (tables)
     {
-        // Clear the flags
-        i->present = 0;
-        i->count = 0;
+        return;
+    }
 
-        // Add the long option
-        if (!i->long_name.empty())
-        {
-            struct option option{};
-            option.name = i->long_name.c_str();
-            if (i->has_value == HasValue::Required)
-            {
-                option.has_arg = required_argument;
-            }
-            else if (i->has_value == HasValue::Optional)
-            {
-                option.has_arg = optional_argument;
-            }
-            else
-            {
-                option.has_arg = no_argument;
-            }
-            option.flag = &i->present;
-            option.val = 1;
+    // The names are copied so that the tables stand alone, whatever happens to this parser
+    auto compiled = std::make_shared<CommandLineTables>();
+    compiled->require_order = std::getenv("POSIXLY_CORRECT") != nullptr;
+    for (size_t i = 0; i < options.size(); i++)
+    {
+        const CommandLineOption &option = options[i];
 
-            long_opts.push_back(option);
+        // Add the long option, which getopt_long_r reports by its position
+        if (!option.long_name.empty())
+        {
+            compiled->long_opts.push_back({ .name = option.long_name, .has_value = option.has_value, .val = LONG_OPTION_BASE + static_cast<int>(i) });
         }
 
         // Add the short option
-        if (i->short_name)
+        if (option.short_name)
         {
-            short_opts += i->short_name;
-            if (i->has_value == HasValue::Required)
+            compiled->short_opts += option.short_name;
+            if (option.has_value == HasValue::Required)
             {
-                short_opts += ":";
+                compiled->short_opts += ":";
             }
-            else if (i->has_value == HasValue::Optional)
+            else if (option.has_value == HasValue::Optional)
             {
-                short_opts += "::";
+                compiled->short_opts += "::";
             }
         }
     }
 
-    // Terminate the long options array
+    // Sorted, keeping the first of any options that share a name in front
+    std::ranges::stable_sort(compiled->long_opts, {}, &CommandLineLongOption::name);
+
+    // The options cannot change any more, so neither can their description
+    append_usage(compiled->usage, options, UsageWidth);
+
+    tables = std::move(compiled);
+}
+
+void CommandLine::Reset()
+{
+    // Keep the space that the values took, the next command line probably has as many
+    for (auto &option : options)
     {
-        struct option option{};
-        memset(&option, 0, sizeof(option));
-        long_opts.push_back(option);
+        option.Clear();
     }
 }
 
-void CommandLine::ParseCommandLine(int argc, char * argv[], const std::string &short_opts, const std::vector<struct option> &long_opts, std::stringstream &error_message)
+void CommandLine::ParseCommandLine(int argc, char * argv[], std::stringstream &error_message)
 {
-    char **argv_copy = new char * [argc];
-    memcpy(argv_copy, argv, argc * sizeof(char *));
+    // getopt_long_r reorders what it is given, so give it a copy
+    arguments.assign(argv, argv + argc);
 
-    // Parse the command line
+    // Parse the command line, starting at the first argument. Nothing is shared with any other parse
+    GetoptState state;
     int opt = 0;
-    optind = 1; // Make sure that we start at the first argument
-    opterr = 0; // We will print our own error messages
     do
     {
         // Get the next option
-        int long_opt_index = -1;
-        opt = getopt_long(argc, argv_copy, short_opts.c_str(), long_opts.data(), &long_opt_index);
+        opt = argc < 1 ? -1 : getopt_long_r(argc, arguments.data(), *tables, state);
 
         // If we have processed all the options then exit
         if (opt == -1)
@@ -166,40 +1018,24 @@ void CommandLine::ParseCommandLine(int argc, char * argv[], const std::string &s
         // If this is an error then alert the user.
         if ((opt == '?') || (opt == ':'))
         {
-            error_message << "Error: Unknown option or missing value " << argv[optind - 1] << std::endl;
+            error_message << "Error: Unknown option or missing value " << arguments[state.optind - 1] << std::endl;
+            continue;
         }
-        // If this is not a short option, then it must be a long one
-        else if (!opt)
-        {
-            // Increment the option count
-            options[long_opt_index].count++;
 
-            // Store the value
-            if (optarg)
-            {
-                options[long_opt_index].value.emplace_back(optarg);
-            }
-        }
-        else
+        // Long options come back as their position, short ones as their name
+        auto option = opt >= LONG_OPTION_BASE ? options.begin() + (opt - LONG_OPTION_BASE) : FindOption(static_cast<char>(opt));
+        if (option != options.end())
         {
-            // Find the option
-            auto option = FindOption(static_cast<char>(opt));
-            if (option != options.end())
-            {
-                // If this is the option then increment the option count
-                option->count++;
-
-                // Store the value
-                if (optarg)
-                {
-                    option->value.emplace_back(optarg);
-                }
-            }
+            option->Store(state.optarg, copy_values);
         }
     } while (opt != -1);
+}
 
-    // Clean up our copy of the arguments
-    delete[] argv_copy;
+void CommandLine::ScanCommandLine(int argc, char * argv[], std::stringstream &error_message)
+{
+    // Finds the options through the tables built by Compile
+    Lookup lookup{ *this };
+    Scan(argc, argv, tables->require_order, lookup, error_message);
 }
 
 bool CommandLine::ValidateOptions(std::stringstream &error_message)
@@ -207,48 +1043,10 @@ bool CommandLine::ValidateOptions(std::stringstream &error_message)
     // Assume that we are going to be successful
     bool rc = true;
 
-    // Check that all the required options are present
-    for (auto i = options.begin(); i != options.end(); ++i)
+    // Check every option, so that every problem is reported
+    for (auto &option : options)
     {
-        // If this option is not present then let's see if we need it.
-        if (!i->count)
-        {
-            // If this option is required then we fail.
-            if (i->required)
-            {
-                error_message << "Error: option " << i->long_name << " is required" << std::endl;
-                rc = false;
-            }
-
-            // We're done
-            continue;
-        }
-
-        // This option is here so let's validate the occurrences.
-        switch (i->occurs_type)
-        {
-        case Occurs::AtLeast:
-            if (i->count < i->occurs_value)
-            {
-                error_message << "Error: option " << i->long_name << " must occur at least " << i->occurs_value << " time(s)" << std::endl;
-                rc = false;
-            }
-            break;
-        case Occurs::AtMost:
-            if (i->count > i->occurs_value)
-            {
-                error_message << "Error: option " << i->long_name << " must occur at most " << i->occurs_value << " time(s)" << std::endl;
-                rc = false;
-            }
-            break;
-        case Occurs::Exactly:
-            if (i->count != i->occurs_value)
-            {
-                error_message << "Error: option " << i->long_name << " must occur exactly " << i->occurs_value << " time(s)" << std::endl;
-                rc = false;
-            }
-            break;
-        }
+        rc = option.Validate(option.long_name, option.required, option.occurs_type, option.occurs_value, option.type, error_message) && rc;
     }
 
     return rc;
@@ -256,20 +1054,69 @@ bool CommandLine::ValidateOptions(std::stringstream &error_message)
 
 bool CommandLine::Parse(int argc, char * argv[], std::stringstream &error_message)
 {
-    std::string short_opts;
-    std::vector<struct option> long_opts;
+    // Convert the option list to getopt_long structures, the first time only
+    Compile();
 
-    // Convert the option list to getopt_long structures.
-    BuildParserParameters(short_opts, long_opts);
+    // Read in the response files
+    bool rc = true;
+    if (response_files)
+    {
+        rc = command_line.Expand(argc, argv, error_message);
+        argc = command_line.Size();
+        argv = command_line.Data();
+    }
 
-    // Extract the options from the command line
-    ParseCommandLine(argc, argv, short_opts, long_opts, error_message);
+    // Extract the options from the command line, forgetting the last one
+    Reset();
+    if (scanner == CommandLineScanner::Native)
+    {
+        ScanCommandLine(argc, argv, error_message);
+    }
+    else
+    {
+        ParseCommandLine(argc, argv, error_message);
+    }
+
+    // Then the options that it did not give from the environment and the config files
+    Lookup lookup{ *this };
+    rc = ScanDefaults(lookup, options.size(), environment_prefix, config_option, tables->require_order, config, error_message) && rc;
 
     // Validate the options read
-    return ValidateOptions(error_message);
+    return ValidateOptions(error_message) && rc;
+}
+
+bool CommandLine::SetConfigOption(std::string_view long_name)
+{
+    auto option = FindOption(long_name);
+    if (option == options.cend() || option->has_value == HasValue::No)
+    {
+        return false;
+    }
+    config_option = static_cast<size_t>(option - options.cbegin());
+    return true;
+}
+
+std::string_view CommandLine::GetUsage()
+{
+    Compile();
+    return tables->usage;
 }
 
 void CommandLine::PrintUsage(char * argv[]) const
+{
+    // Described when the parser was compiled, unless that was for some other width
+    size_t width = TerminalWidth();
+    if (tables && width == UsageWidth)
+    {
+        PrintUsage(argv, tables->usage);
+        return;
+    }
+    std::string text;
+    append_usage(text, options, width);
+    PrintUsage(argv, text);
+}
+
+void CommandLine::PrintUsage(char * argv[], std::string_view options)
 {
     // Get the executable name
     const char *executable = strrchr(argv[0], '/');
@@ -282,114 +1129,62 @@ void CommandLine::PrintUsage(char * argv[]) const
         executable++;
     }
 
+    // Put the introduction in front of the options, and write the lot at once
+    std::string text;
+    text += "Usage: ";
+    text += executable;
     if (options.empty())
     {
-        std::cerr << "Usage: " << executable << std::endl;
+        text += '\n';
     }
     else
     {
-        // Print introduction
-        std::cerr << "Usage: " << executable << " <options>" << std::endl;
-        std::cerr << "Where <options> is one or more of the following:" << std::endl;
-        std::cerr << std::endl;
-
-        // Print options
-        for (const auto & option : options)
-        {
-            // If we have a short name then print it
-            if (option.short_name)
-            {
-                std::cerr << "-" << option.short_name << " ";
-            }
-            // Otherwise just fill with blanks
-            else
-            {
-                std::cerr << "   ";
-            }
-
-            // If we have a long name then print it
-            if (!option.long_name.empty())
-            {
-                std::cerr << "--" << option.long_name << " ";
-            }
-
-            // If this option takes a value then print it
-            if (option.has_value != HasValue::No)
-            {
-                std::cerr << "<value> ";
-            }
-
-            // Print the help
-            std::cerr << std::endl << "\t" << option.help << std::endl;
-
-            // Optional or required.
-            std::cerr << "\t\tThis option is " << (option.required ? "required" : "optional") << "." << std::endl;
+        text += " <options>\n";
+        text += "Where <options> is one or more of the following:\n";
+        text += '\n';
+        text += options;
+    }
+    std::cerr.write(text.data(), static_cast<std::streamsize>(text.size()));
+    std::cerr.flush();
+}
 
-            // If this option takes a value then print it
-            if (option.has_value != HasValue::No)
-            {
-                if (option.required)
-                {
-                    std::cerr << "\t\tThis option ";
-                }
-                else
-                {
-                    std::cerr << "\t\tIf this option occurs, then it ";
-                }
-
-                // Occurrences
-                switch (option.occurs_type)
-                {
-                case Occurs::AtLeast:
-                    std::cerr << "must occur at least " << option.occurs_value << " time(s) ";
-                    break;
-                case Occurs::AtMost:
-                    std::cerr << "must occur at most " << option.occurs_value << " time(s) ";
-                    break;
-                case Occurs::Exactly:
-                    std::cerr << "must occur exactly " << option.occurs_value << " time(s) ";
-                    break;
-                }
-
-                // Line done
-                std::cerr << std::endl;
-
-                switch (option.has_value)
-                {
-                case HasValue::No:
-                    std::cerr << "\t\tThis option has no value";
-                    break;
-                case HasValue::Required:
-                    std::cerr << "\t\tThis option must have a value";
-                    break;
-                case HasValue::Optional:
-                    std::cerr << "\t\tThis option may have a value";
-                    break;
-                }
-
-                // Line done
-                std::cerr << std::endl;
-            }
-        }
+size_t CommandLine::TerminalWidth()
+{
+#ifndef _MSC_VER
+    struct winsize size{};
+    if (isatty(STDERR_FILENO) && ioctl(STDERR_FILENO, TIOCGWINSZ, &size) == 0 && size.ws_col)
+    {
+        return size.ws_col;
     }
+#endif
+    size_t columns = 0;
+    const char *value = std::getenv("COLUMNS");
+    if (value && std::from_chars(value, value + strlen(value), columns).ec == std::errc{} && columns)
+    {
+        return columns;
+    }
+    return UsageWidth;
 }
 
-std::vector<CommandLineOption>::const_iterator CommandLine::FindOption(const std::string &long_name) const
+std::vector<CommandLineOption>::const_iterator CommandLine::FindOption(std::string_view long_name) const
 {
-    return std::ranges::find_if(options, [&long_name](const CommandLineOption &value) -> bool { return value.long_name == long_name; });
+    auto i = long_index.find(long_name);
+    return i != long_index.end() ? options.cbegin() + static_cast<std::ptrdiff_t>(i->second) : options.cend();
 }
 
-std::vector<CommandLineOption>::const_iterator CommandLine::FindOption(const char long_name) const
+std::vector<CommandLineOption>::const_iterator CommandLine::FindOption(const char short_name) const
 {
-    return std::ranges::find_if(options, [&long_name](const CommandLineOption &value) -> bool { return value.short_name == long_name; });
+    size_t index = short_name ? short_index[static_cast<unsigned char>(short_name)] : NoOption;
+    return index != NoOption ? options.cbegin() + static_cast<std::ptrdiff_t>(index) : options.cend();
 }
 
-std::vector<CommandLineOption>::iterator CommandLine::FindOption(const char long_name)
+std::vector<CommandLineOption>::iterator CommandLine::FindOption(const char short_name)
 {
-    return std::ranges::find_if(options, [&long_name](const CommandLineOption &value) -> bool { return value.short_name == long_name; });
+    size_t index = short_name ? short_index[static_cast<unsigned char>(short_name)] : NoOption;
+    return index != NoOption ? options.begin() + static_cast<std::ptrdiff_t>(index) : options.end();
 }
 
-const std::vector<std::string> &CommandLine::GetOptionValues(const std::string &long_name) const
+const std::vector<std::string> &CommandLine::GetOptionValues(std::string_view long_name) const
 {
     auto i = FindOption(long_name);
     return (i != options.cend()) && (i->count > 0)? i->value : empty;
@@ -401,7 +1196,13 @@ const std::vector<std::string> &CommandLine::GetOptionValues(const char short_na
     return (i != options.cend()) && (i->count > 0)? i->value : empty;
 }
 
-bool CommandLine::IsOptionValue(const std::string &long_name) const
+const CommandLineValueViews &CommandLine::GetOptionViews(std::string_view long_name) const
+{
+    auto i = FindOption(long_name);
+    return (i != options.cend()) && (i->count > 0)? i->views : empty_views;
+}
+
+bool CommandLine::IsOptionValue(std::string_view long_name) const
 {
     auto i = FindOption(long_name);
     return i != options.cend() && (i->count > 0);
@@ -28,8 +28,20 @@
 /*---------------------------------------------------------------------
   -- C++ standard includes
   ---------------------------------------------------------------------*/
+#include <array>
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <span>
 #include <string>
 #include <string_view>
+#include <type_traits>
+#include <unordered_map>
 #include <vector>
 #include <sstream>
 
@@ -40,6 +52,8 @@
 /*---------------------------------------------------------------------
   -- forward declarations
   ---------------------------------------------------------------------*/
+struct CommandLineTables;
+struct CommandLineFile;
 
 /*---------------------------------------------------------------------
   -- data types
@@ -82,7 +96,402 @@ enum class Occurs
     Exactly,
 };
 
-struct CommandLineOption
+/**
+ * How the command line is scanned for options.
+ */
+enum class CommandLineScanner
+{
+    /**
+     * The getopt_long way, reordering a copy of the arguments so that the options come first.
+     */
+    Getopt,
+    /**
+     * A single pass over the arguments as they are, finding each option through the lookup tables.
+     */
+    Native,
+};
+
+/**
+ * What the value of an option must be.
+ */
+enum class ValueType
+{
+    /**
+     * Anything, kept as it is.
+     */
+    Text,
+    /**
+     * A whole number in a range.
+     */
+    Integer,
+    /**
+     * A number in a range, which may have a fraction or an exponent.
+     */
+    Float,
+    /**
+     * One of a list of names, each standing for a number.
+     */
+    Enum,
+    /**
+     * A number followed by ns, us, ms, s, m or h, or by nothing to use the option's unit.
+     */
+    Duration,
+    /**
+     * A numeric IPv4 or IPv6 address.
+     */
+    Address,
+};
+
+/**
+ * A name that an Enum value may be, and the number that it stands for.
+ */
+struct CommandLineEnumName
+{
+    std::string_view name;
+    int64_t value;
+};
+
+/**
+ * The type of an option's value, and its limits. Built with the functions below, Text if not. Can be
+ * built at compile time, so it can be part of a CommandLineOptionSpec.
+ */
+struct CommandLineValueType
+{
+    ValueType type{ValueType::Text};
+    int64_t minimum{std::numeric_limits<int64_t>::min()}; // Integer, or Duration in nanoseconds
+    int64_t maximum{std::numeric_limits<int64_t>::max()};
+    double real_minimum{-std::numeric_limits<double>::infinity()}; // Float
+    double real_maximum{std::numeric_limits<double>::infinity()};
+    std::span<const CommandLineEnumName> names; // Enum, which must outlive the parser
+    std::chrono::nanoseconds unit{std::chrono::seconds{1}}; // Duration without a suffix
+
+    /**
+     * A whole number.
+     *
+     * @param minimum The least it may be.
+     * @param maximum The most it may be.
+     * @return        The type.
+     */
+    static constexpr CommandLineValueType Integer(int64_t minimum = std::numeric_limits<int64_t>::min(), int64_t maximum = std::numeric_limits<int64_t>::max())
+    {
+        CommandLineValueType type;
+        type.type = ValueType::Integer;
+        type.minimum = minimum;
+        type.maximum = maximum;
+        return type;
+    };
+
+    /**
+     * A number that may have a fraction.
+     *
+     * @param minimum The least it may be.
+     * @param maximum The most it may be.
+     * @return        The type.
+     */
+    static constexpr CommandLineValueType Float(double minimum = -std::numeric_limits<double>::infinity(), double maximum = std::numeric_limits<double>::infinity())
+    {
+        CommandLineValueType type;
+        type.type = ValueType::Float;
+        type.real_minimum = minimum;
+        type.real_maximum = maximum;
+        return type;
+    };
+
+    /**
+     * One of a list of names.
+     *
+     * @param names Each name, and the number that it stands for. Not copied, so it must outlive the parser.
+     * @return      The type.
+     */
+    static constexpr CommandLineValueType Enum(std::span<const CommandLineEnumName> names)
+    {
+        CommandLineValueType type;
+        type.type = ValueType::Enum;
+        type.names = names;
+        return type;
+    };
+
+    /**
+     * A length of time.
+     *
+     * @param unit    What a number without a suffix counts.
+     * @param minimum The shortest it may be.
+     * @param maximum The longest it may be.
+     * @return        The type.
+     */
+    static constexpr CommandLineValueType Duration(std::chrono::nanoseconds unit = std::chrono::seconds{1}, std::chrono::nanoseconds minimum = std::chrono::nanoseconds::zero(), std::chrono::nanoseconds maximum = std::chrono::nanoseconds::max())
+    {
+        CommandLineValueType type;
+        type.type = ValueType::Duration;
+        type.minimum = minimum.count();
+        type.maximum = maximum.count();
+        type.unit = unit;
+        return type;
+    };
+
+    /**
+     * A TCP or UDP port number.
+     *
+     * @return The type.
+     */
+    static constexpr CommandLineValueType Port()
+    {
+        return Integer(0, 65535);
+    };
+
+    /**
+     * A numeric IP address, which is not looked up.
+     *
+     * @return The type.
+     */
+    static constexpr CommandLineValueType Address()
+    {
+        CommandLineValueType type;
+        type.type = ValueType::Address;
+        return type;
+    };
+};
+
+/**
+ * A numeric IP address, in network order.
+ */
+struct CommandLineAddress
+{
+    size_t size; // 4 for IPv4, 16 for IPv6
+    std::array<unsigned char, 16> bytes;
+};
+
+/**
+ * A value converted to its type when it was parsed.
+ */
+struct CommandLineValue
+{
+    int64_t integer; // Integer, Enum, or Duration in nanoseconds
+    double real;     // Float
+    CommandLineAddress address;
+};
+
+/**
+ * Values of an option. The first is held in place, so the usual single value needs no allocation.
+ */
+template <typename T>
+class CommandLineValueList
+{
+protected:
+    T first{};
+    std::vector<T> rest;
+    size_t size{0};
+
+public:
+    /**
+     * Forget the values, keeping the space that they took.
+     */
+    void Clear()
+    {
+        size = 0;
+        rest.clear();
+    };
+
+    /**
+     * Add a value.
+     *
+     * @param value The value.
+     */
+    void Add(const T &value)
+    {
+        if (size++)
+        {
+            rest.push_back(value);
+        }
+        else
+        {
+            first = value;
+        }
+    };
+
+    /**
+     * Get the number of values.
+     *
+     * @return The number of values.
+     */
+    [[nodiscard]] size_t Size() const { return size; };
+
+    /**
+     * Get a value.
+     *
+     * @param index Which value, in the order they were given.
+     * @return      The value, or an empty one if there are not that many.
+     */
+    [[nodiscard]] T operator[](size_t index) const { return index >= size ? T{} : index ? rest[index - 1] : first; };
+};
+
+/**
+ * The values of an option, as views into the arguments that were parsed, so they are only valid for as
+ * long as those are.
+ */
+using CommandLineValueViews = CommandLineValueList<std::string_view>;
+
+/**
+ * Tells whether a type is a std::chrono::duration, and what number it is made from.
+ */
+template <typename T>
+struct IsCommandLineDuration : std::false_type
+{
+    using rep = T;
+};
+
+template <typename Rep, typename Period>
+struct IsCommandLineDuration<std::chrono::duration<Rep, Period>> : std::true_type
+{
+    using rep = Rep;
+};
+
+/**
+ * What a parse found for an option.
+ */
+struct CommandLineOptionState
+{
+    int present;
+    int count;
+    std::vector<std::string> value; // Copies of the values, only kept if SetCopyValues has not turned it off
+    CommandLineValueViews views;    // The values where they are in the arguments
+    CommandLineValueList<CommandLineValue> converted; // The values converted to the type, unless it is Text
+
+    /**
+     * Forget what was found, keeping the space that the values took.
+     */
+    void Clear()
+    {
+        present = 0;
+        count = 0;
+        value.clear();
+        views.Clear();
+        converted.Clear();
+    };
+
+    /**
+     * Count another occurrence of the option.
+     *
+     * @param text The value that it was given, nullptr if none.
+     * @param copy Whether to keep a copy of the value as well as a view of it.
+     */
+    void Store(const char *text, bool copy)
+    {
+        present = 1;
+        count++;
+        if (text)
+        {
+            views.Add(text);
+            if (copy)
+            {
+                value.emplace_back(text);
+            }
+        }
+    };
+
+    /**
+     * Check that the option occurred as it should, and convert its values to their type.
+     *
+     * @param long_name     The option's long name, for the errors.
+     * @param required      Whether the option must occur.
+     * @param occurs_type   How to interpret the number of occurrences.
+     * @param occurs_value  Number of occurrences.
+     * @param type          What the values must be.
+     * @param error_message Where problems are described.
+     * @return              True if the option is as it should be.
+     */
+    bool Validate(std::string_view long_name, bool required, Occurs occurs_type, int occurs_value, const CommandLineValueType &type, std::stringstream &error_message);
+
+    /**
+     * Get a value. If the option has a type, then this is the value converted by Validate, cast to T. An
+     * enum gets the number that its name stands for, a std::chrono::duration the duration, and a number a
+     * duration in nanoseconds. Otherwise numbers are converted from the text now. A std::string_view is
+     * always the text.
+     *
+     * @param type  What the values are.
+     * @param value Where the value goes. Left alone if the option was not given, so it can hold the
+     *              default beforehand.
+     * @param index Which value, for options that occur more than once.
+     * @return      False if the value cannot be had as a T.
+     */
+    template <typename T>
+    bool GetValue(const CommandLineValueType &type, T &value, size_t index = 0) const
+    {
+        if (index >= views.Size())
+        {
+            return true;
+        }
+
+        // The text, or what it was converted to
+        if constexpr (std::is_same_v<T, std::string_view>)
+        {
+            value = views[index];
+            return true;
+        }
+        else if constexpr (std::is_same_v<T, CommandLineAddress>)
+        {
+            if (type.type != ValueType::Address)
+            {
+                return false;
+            }
+            value = converted[index].address;
+            return true;
+        }
+        else if (type.type != ValueType::Text)
+        {
+            CommandLineValue result = converted[index];
+            if constexpr (IsCommandLineDuration<T>::value)
+            {
+                value = std::chrono::duration_cast<T>(std::chrono::nanoseconds{result.integer});
+            }
+            else if constexpr (std::is_arithmetic_v<T> || std::is_enum_v<T>)
+            {
+                value = type.type == ValueType::Float ? static_cast<T>(result.real) : static_cast<T>(result.integer);
+            }
+            else
+            {
+                static_assert(std::is_arithmetic_v<T>, "GetOptionValue needs a number, an enum, a duration, an address or a std::string_view");
+            }
+            return true;
+        }
+
+        // No type, so the text must be all number
+        std::string_view text = views[index];
+        if constexpr (std::is_arithmetic_v<T> || IsCommandLineDuration<T>::value)
+        {
+            typename IsCommandLineDuration<T>::rep number{};
+            auto [end, error] = std::from_chars(text.data(), text.data() + text.size(), number);
+            if (error != std::errc{} || end != text.data() + text.size() || text.empty())
+            {
+                return false;
+            }
+            value = T{number};
+            return true;
+        }
+        else
+        {
+            return false;
+        }
+    };
+};
+
+/**
+ * An option as it is declared. Everything in it can be known at compile time, so an array of them can
+ * describe a command line to StaticCommandLine.
+ */
+struct CommandLineOptionSpec
+{
+    std::string_view long_name;
+    char short_name;
+    bool required;
+    HasValue has_value;
+    Occurs occurs_type;
+    int occurs_value;
+    std::string_view help;
+    CommandLineValueType type{};
+};
+
+struct CommandLineOption : CommandLineOptionState
 {
     std::string long_name;
     char short_name;
@@ -91,57 +500,165 @@ struct CommandLineOption
     Occurs occurs_type;
     int occurs_value;
     std::string help;
+    CommandLineValueType type;
+};
 
-    int present;
-    int count;
-    std::vector<std::string> value;
+/**
+ * Hashes any kind of string the same way, so that a map keyed on std::string can be searched with a
+ * std::string_view without building a temporary string.
+ */
+struct CommandLineHash
+{
+    using is_transparent = void;
+
+    size_t operator()(std::string_view value) const { return std::hash<std::string_view>{}(value); }
+};
+
+/**
+ * The arguments that a parse reads, with every argument that starts with @ replaced by the arguments in
+ * the file that it names, a response file. An argument that starts with @@ is not a response file, but
+ * itself without the first @. Response files can name more response files. A file is mapped
+ * into memory and split into arguments where it is, so the arguments are views into it that cost nothing
+ * to copy, however many there are. They are separated by white space, can be quoted with ' or " and
+ * escaped with \, and a # at the start of one comments out the rest of the line.
+ */
+class CommandLineArguments
+{
+protected:
+    std::vector<char *> arguments; // Kept to save allocating them on every parse
+    std::vector<std::shared_ptr<const CommandLineFile>> files; // The mapped files that the arguments point into
+
+    /**
+     * Add the arguments in a response file.
+     *
+     * @param path          Where the file is.
+     * @param depth         How many response files name this one, to stop one that names itself.
+     * @param error_message Where problems with the file are described.
+     * @return              False if the file, or one that it names, cannot be read.
+     */
+    bool Include(const char *path, int depth, std::stringstream &error_message);
+
+public:
+    /**
+     * Forget the arguments, unmapping the files unless a copy still uses them.
+     */
+    void Clear();
+
+    /**
+     * Take the arguments of a command line, reading in the response files that it names.
+     *
+     * @param argc          Number of parameters
+     * @param argv          Parameter array
+     * @param error_message Where problems with the response files are described.
+     * @return              False if a response file cannot be read. The rest of the arguments are still taken.
+     */
+    bool Expand(int argc, char * argv[], std::stringstream &error_message);
+
+    /**
+     * Add the arguments in a file, as if it were a response file. The first file read is given an empty
+     * argument in front, so that the arguments can be scanned as a command line.
+     *
+     * @param path          Where the file is.
+     * @param error_message Where problems with the file are described.
+     * @return              False if the file, or a response file that it names, cannot be read.
+     */
+    bool Read(std::string_view path, std::stringstream &error_message);
+
+    /**
+     * Get the number of arguments, as argc.
+     *
+     * @return The number of arguments.
+     */
+    [[nodiscard]] int Size() const { return static_cast<int>(arguments.size()); };
+
+    /**
+     * Get the arguments, as argv. They are valid until the next Clear, Expand or Read.
+     *
+     * @return The arguments.
+     */
+    [[nodiscard]] char **Data() { return arguments.data(); };
 };
 
 class CommandLine
 {
+public:
+    /**
+     * Index of a name that no option uses.
+     */
+    static constexpr size_t NoOption = static_cast<size_t>(-1);
+
+    /**
+     * Width that the usage is wrapped to when there is no terminal to fit.
+     */
+    static constexpr size_t UsageWidth = 80;
+
 protected:
     std::vector<CommandLineOption> options;
+    std::array<size_t, 256> short_index; // Position in options of each short name, NoOption if not used
+    std::unordered_map<std::string, size_t, CommandLineHash, std::equal_to<>> long_index; // Position in options of each long name
+    std::shared_ptr<const CommandLineTables> tables; // Built by Compile, and shared by the copies of a compiled parser
+    std::vector<char *> arguments; // Copy of argv for getopt_long_r to reorder, kept to save allocating it on every Parse
+    CommandLineArguments command_line; // The arguments with the response files read in
+    CommandLineArguments config;       // The arguments in the config files
+    std::string environment_prefix;    // Empty if the environment is not read
+    size_t config_option{NoOption};    // The option that names the config files
+    CommandLineScanner scanner{CommandLineScanner::Getopt};
+    bool copy_values{true};
+    bool response_files{true};
+
+    /**
+     * Finds the options for Scan and ScanDefaults.
+     */
+    struct Lookup;
 
     /**
-     * Convert the options to a short_opts and long_opts structures used by getopt_long
+     * Add an option to the lookup tables. If the names are already used, then the first option keeps them.
      *
-     * @param short_opts Short options. A single letter or digit (-h, -4, ...)
-     * @param long_opts Long option. A word (--help, --ipv4, ...)
+     * @param index Position of the option in options.
+     */
+    void IndexOption(size_t index);
+
+    /**
+     * Use the tables to extract the options from the command line. Only touches this parser, so different
+     * parsers can do this on different threads at the same time.
      *
-     * @see options
-     * @see get_option
+     * @param argc Number of parameters
+     * @param argv Parameter array
+     * @param error_message Where problems with the parameters are described.
      */
-    void BuildParserParameters(std::string &short_opts, std::vector<struct option> &long_opts);
+    void ParseCommandLine(int argc, char * argv[], std::stringstream &error_message);
 
     /**
-     * Use the getopt_long options to extract the options from the command line.
+     * Extract the options from the command line in a single pass, without copying or reordering it.
+     * Finds the same options as ParseCommandLine.
      *
      * @param argc Number of parameters
      * @param argv Parameter array
-     * @param short_opts Short options.
-     * @param long_opts options.
+     * @param error_message Where problems with the parameters are described.
      */
-    void ParseCommandLine(int argc, char * argv[], const std::string &short_opts, const std::vector<struct option> &long_opts, std::stringstream &error_message);
+    void ScanCommandLine(int argc, char * argv[], std::stringstream &error_message);
 
     /**
-     * Validate whether the command line options are consistent with the defined options.
+     * Validate whether the command line options are consistent with the defined options, and convert
+     * the values that have a type.
      *
      * @return True if the option values are consistent.
      */
     bool ValidateOptions(std::stringstream &error_message);
 
 public:
-    CommandLine() = default;
+    CommandLine();
     explicit CommandLine(const std::vector<CommandLineOption> &options);
+    explicit CommandLine(std::span<const CommandLineOptionSpec> options);
     virtual ~CommandLine() = default;
 
     /**
      * Empty the options.
      */
-    void Clean() { options.clear(); };
+    void Clean();
 
     /**
-     * Add a command line option. All command line options must be added before calling Parse.
+     * Add a command line option. All command line options must be added before calling Compile or Parse.
      * 
      * @param long_name  The long name of the option. This name must be prefixed by -- in the command line.
      * @param short_name The short name of the option. This name must be prefixed by - in the command line.
@@ -150,11 +667,88 @@ public:
      * @param occurs_type How to interpret the number of occurrences.
      * @param occurs_value  Number of occurrences for this option.
      * @param help       A help string that describes the option. This will be printed by the PrintUsage function.
+     * @param type       What the values must be. They are converted once, by Parse, which fails if they
+     *                   cannot be. If not specified, then anything.
+     * @return           False if the parser has already been compiled.
      *
      * @see Occurs
      * @see HasValue
+     * @see CommandLineValueType
+     */
+    bool AddOption(const std::string_view &long_name, char short_name, bool required, HasValue has_value, Occurs occurs_type, int occurs_value, const std::string_view &help, const CommandLineValueType &type = {});
+
+    /**
+     * Build the tables used to parse a command line. No more options can be added after this, but any
+     * number of command lines can be parsed without building them again. Copies of a compiled parser
+     * share its tables. Parse calls this if it has not been called already.
+     */
+    void Compile();
+
+    /**
+     * Check if the parser has been compiled.
+     *
+     * @return True if Compile has been called.
+     */
+    [[nodiscard]] bool IsCompiled() const { return tables != nullptr; };
+
+    /**
+     * Choose how Parse scans the command line.
+     *
+     * @param value The scanner to use. If not set, then CommandLineScanner::Getopt.
+     */
+    void SetScanner(CommandLineScanner value) { scanner = value; };
+
+    /**
+     * Get how Parse scans the command line.
+     *
+     * @return The scanner in use.
+     */
+    [[nodiscard]] CommandLineScanner GetScanner() const { return scanner; };
+
+    /**
+     * Choose whether Parse copies the values into CommandLineOption::value, for GetOptionValues, as well as
+     * keeping views of them. Without the copies the values are only valid while the arguments are, but
+     * parsing does not allocate a string for every one.
+     *
+     * @param value True to copy the values. If not set, then they are copied.
+     */
+    void SetCopyValues(bool value) { copy_values = value; };
+
+    /**
+     * Choose whether Parse reads the arguments in the response file named by an argument that starts with @.
+     * Any argument can name one, the value of an option too, so an argument that starts with @@ is taken
+     * as it is, less the first @.
+     *
+     * @param value True to read response files. If not set, then they are read.
+     *
+     * @see CommandLineArguments
+     */
+    void SetResponseFiles(bool value) { response_files = value; };
+
+    /**
+     * Have Parse take the options that the command line does not give from environment variables. An
+     * option's variable is its long name in capitals, with - changed to _, after the prefix, so with the
+     * prefix CLI_ the option --idle-timeout is CLI_IDLE_TIMEOUT. An option that has no value is given if
+     * its variable is set to anything other than nothing, 0, false, no or off.
+     *
+     * @param prefix What every variable starts with. If not set, or empty, then the environment is not read.
      */
-    void AddOption(const std::string_view &long_name, char short_name, bool required, HasValue has_value, Occurs occurs_type, int occurs_value, const std::string_view &help);
+    void SetEnvironmentPrefix(std::string_view prefix) { environment_prefix = prefix; };
+
+    /**
+     * Have Parse read files of options, named by an option. The files are written as command lines, and
+     * they only give the options that neither the command line nor the environment gives, so an option
+     * that may only occur once can still be given in both places. Call after the option has been added.
+     *
+     * @param long_name The long name of the option whose values are the files.
+     * @return          False if there is no such option.
+     */
+    bool SetConfigOption(std::string_view long_name);
+
+    /**
+     * Forget what the last Parse found, keeping the options. Parse calls this before it starts.
+     */
+    void Reset();
 
     /**
      * Find a command line option by its long name.
@@ -162,7 +756,7 @@ public:
      * @param long_name The long name of the option.
      * @return          A const iterator to the option if found, or end() if not found.
      */
-    [[nodiscard]] std::vector<CommandLineOption>::const_iterator FindOption(const std::string &long_name) const;
+    [[nodiscard]] std::vector<CommandLineOption>::const_iterator FindOption(std::string_view long_name) const;
 
     /**
      * Find a command line option by its short name.
@@ -181,28 +775,55 @@ public:
     [[nodiscard]] std::vector<CommandLineOption>::iterator FindOption(char short_name);
 
     /**
-     * Get the value of a command line option.
+     * Get the value of a command line option. Empty if SetCopyValues has turned the copies off.
      * 
      * @param long_name The long name of the option.
      * @return          The value of the option.
      */
-    [[nodiscard]] const std::vector<std::string> &GetOptionValues(const std::string &long_name) const;
+    [[nodiscard]] const std::vector<std::string> &GetOptionValues(std::string_view long_name) const;
 
     /**
-     * Get the value of a command line option.
+     * Get the value of a command line option. Empty if SetCopyValues has turned the copies off.
      * 
      * @param shortname The short name of the option.
      * @return          The value of the option.
      */
     [[nodiscard]] const std::vector<std::string> &GetOptionValues(char shortname) const;
 
+    /**
+     * Get the values of a command line option without copying them.
+     *
+     * @param long_name The long name of the option.
+     * @return          Views of the values, which are only valid while the parsed arguments are.
+     */
+    [[nodiscard]] const CommandLineValueViews &GetOptionViews(std::string_view long_name) const;
+
+    /**
+     * Get a value of a command line option. If the option has a type, then this is the value converted by
+     * Parse, cast to T. An enum gets the number that its name stands for, a std::chrono::duration the
+     * duration, and a number a duration in nanoseconds. Otherwise numbers are converted from the text now.
+     * A std::string_view is always the text.
+     *
+     * @param long_name The long name of the option.
+     * @param value     Where the value goes. Left alone if the option was not given, so it can hold the
+     *                  default beforehand.
+     * @param index     Which value, for options that occur more than once.
+     * @return          False if the value cannot be had as a T.
+     */
+    template <typename T>
+    bool GetOptionValue(std::string_view long_name, T &value, size_t index = 0) const
+    {
+        auto i = FindOption(long_name);
+        return i == options.cend() || i->GetValue(i->type, value, index);
+    };
+
     /**
      * Check if an option has a value.
      *
      * @param long_name The long name of the option.
      * @return          True if the option is present, false otherwise.
      */
-    [[nodiscard]] bool IsOptionValue(const std::string &long_name) const;
+    [[nodiscard]] bool IsOptionValue(std::string_view long_name) const;
 
     /**
      * Check if an option has a value.
@@ -213,7 +834,8 @@ public:
     [[nodiscard]] bool IsOptionValue(char short_name) const;
 
     /**
-     * Parse the command line arguments.
+     * Parse the command line arguments. Can be called any number of times, each call starts afresh. Parsers
+     * share nothing while parsing, so different ones can parse on different threads at the same time.
      * 
      * @param argc The number of command line arguments.
      * @param argv The command line arguments.
@@ -221,12 +843,696 @@ public:
      */
     bool Parse(int argc, char * argv[], std::stringstream &error_message);
 
+    /**
+     * Extract the options from a command line in a single pass, without copying or reordering it. This is
+     * the Native scanner, and StaticCommandLine's, whatever the options are held in.
+     *
+     * @param argc          Number of parameters
+     * @param argv          Parameter array
+     * @param require_order Stop at the first operand, rather than looking past it.
+     * @param lookup        The options, through FindShort(char) and FindLong(std::string_view), which
+     *                      give an option's position or NoOption, GetHasValue(position), and
+     *                      Store(position, value), which counts an occurrence with its value or nullptr.
+     * @param error_message Where problems with the parameters are described.
+     */
+    template <typename Lookup>
+    static void Scan(int argc, char * argv[], bool require_order, Lookup &lookup, std::stringstream &error_message)
+    {
+        auto report = [&error_message](const char *argument) {
+            error_message << "Error: Unknown option or missing value " << argument << std::endl;
+        };
+
+        for (int i = 1; i < argc; i++)
+        {
+            const char *argument = argv[i];
+
+            // Operands are passed over, unless the options must come before them
+            if ((argument[0] != '-') || (argument[1] == '\0'))
+            {
+                if (require_order)
+                {
+                    break;
+                }
+                continue;
+            }
+
+            // Everything after "--" is an operand
+            if (std::string_view{argument} == "--")
+            {
+                break;
+            }
+
+            // A long option, with its value after = or in the next argument
+            if (argument[1] == '-')
+            {
+                std::string_view name{argument + 2};
+                const char *value = nullptr;
+                if (size_t equals = name.find('='); equals != std::string_view::npos)
+                {
+                    value = argument + 2 + equals + 1;
+                    name = name.substr(0, equals);
+                }
+                size_t index = lookup.FindLong(name);
+                if ((index == NoOption) || (value && lookup.GetHasValue(index) == HasValue::No))
+                {
+                    report(argument);
+                    continue;
+                }
+                if (!value && lookup.GetHasValue(index) == HasValue::Required)
+                {
+                    if (i + 1 == argc)
+                    {
+                        report(argument);
+                        continue;
+                    }
+                    value = argv[++i];
+                }
+                lookup.Store(index, value);
+                continue;
+            }
+
+            // Short options, as many as there are until one takes the rest as its value
+            for (const char *p = argument + 1; *p; p++)
+            {
+                size_t index = *p == ':' ? NoOption : lookup.FindShort(*p);
+                if (index == NoOption)
+                {
+                    report(argument);
+                    continue;
+                }
+                HasValue has_value = lookup.GetHasValue(index);
+                if (has_value == HasValue::No)
+                {
+                    lookup.Store(index, nullptr);
+                    continue;
+                }
+
+                // The rest of the argument is the value, or if there is none, the next argument if it must have one
+                const char *value = p[1] ? p + 1 : nullptr;
+                if (!value && has_value == HasValue::Required)
+                {
+                    if (i + 1 == argc)
+                    {
+                        report(argument);
+                        break;
+                    }
+                    value = argv[++i];
+                }
+                lookup.Store(index, value);
+                break;
+            }
+        }
+    };
+
+    /**
+     * Take the options that a command line did not give from the environment, and then from the config
+     * files, as SetEnvironmentPrefix and SetConfigOption describe. The lower layers only give the options
+     * that the ones above did not, so each option only counts the occurrences of one layer.
+     *
+     * @param lookup             The options, as Scan has them, which also give GetLongName(position) and
+     *                           GetState(position), what has been found for an option so far.
+     * @param size               Number of options.
+     * @param environment_prefix What the environment variables start with, empty to not read them.
+     * @param config_option      Position of the option that names the config files, NoOption if none.
+     * @param require_order      Stop at the first operand in a config file, rather than looking past it.
+     * @param config             Where the config files are read into. Their values point into it.
+     * @param error_message      Where problems with the options are described.
+     * @return                   False if a config file cannot be read.
+     */
+    template <typename Lookup>
+    static bool ScanDefaults(Lookup &lookup, size_t size, std::string_view environment_prefix, size_t config_option, bool require_order, CommandLineArguments &config, std::stringstream &error_message)
+    {
+        // The environment, for the options that the command line did not give
+        if (!environment_prefix.empty())
+        {
+            std::string name;
+            for (size_t i = 0; i < size; i++)
+            {
+                std::string_view long_name = lookup.GetLongName(i);
+                if (lookup.GetState(i).count || long_name.empty())
+                {
+                    continue;
+                }
+                name.assign(environment_prefix);
+                for (char c : long_name)
+                {
+                    name += c == '-' ? '_' : static_cast<char>(c >= 'a' && c <= 'z' ? c - 'a' + 'A' : c);
+                }
+                const char *value = std::getenv(name.c_str());
+                if (!value)
+                {
+                    continue;
+                }
+
+                // A flag is given by any setting that does not say no, anything else by a value
+                HasValue has_value = lookup.GetHasValue(i);
+                if (has_value == HasValue::No)
+                {
+                    std::string_view setting{value};
+                    if (!setting.empty() && setting != "0" && setting != "false" && setting != "no" && setting != "off")
+                    {
+                        lookup.Store(i, nullptr);
+                    }
+                }
+                else if (*value || has_value == HasValue::Optional)
+                {
+                    lookup.Store(i, *value ? value : nullptr);
+                }
+            }
+        }
+
+        // The config files, named by the command line or the environment
+        config.Clear();
+        if (config_option == NoOption || !lookup.GetState(config_option).count)
+        {
+            return true;
+        }
+        bool rc = true;
+        const CommandLineValueViews &paths = lookup.GetState(config_option).views;
+        for (size_t i = 0; i < paths.Size(); i++)
+        {
+            rc = config.Read(paths[i], error_message) && rc;
+        }
+
+        // Only for the options that nothing above gave
+        struct LowerLookup
+        {
+            Lookup &lookup;
+            std::vector<bool> given;
+
+            size_t FindShort(char name) const { return lookup.FindShort(name); }
+            size_t FindLong(std::string_view name) const { return lookup.FindLong(name); }
+            HasValue GetHasValue(size_t index) const { return lookup.GetHasValue(index); }
+            void Store(size_t index, const char *value)
+            {
+                if (!given[index])
+                {
+                    lookup.Store(index, value);
+                }
+            }
+        } lower{ lookup, std::vector<bool>(size) };
+        for (size_t i = 0; i < size; i++)
+        {
+            lower.given[i] = lookup.GetState(i).count > 0;
+        }
+        Scan(config.Size(), config.Data(), require_order, lower, error_message);
+
+        return rc;
+    };
+
+    /**
+     * Describe the options the way PrintUsage does, one to a line with the help lined up in a column
+     * after the names, and wrapped to fit. Can be run at compile time.
+     *
+     * @param out     Where the description is appended.
+     * @param options The options.
+     * @param width   Widest line, in characters. Lines are not wrapped if 0.
+     */
+    static constexpr void AppendUsage(std::string &out, std::span<const CommandLineOptionSpec> options, size_t width)
+    {
+        constexpr size_t max_name_column = 32; // Names longer than this put their help on the next line
+        constexpr size_t min_text_width = 24;  // However narrow the lines, the help gets this much
+
+        auto append_number = [](std::string &text, int value) {
+            char digits[16]{};
+            size_t size = 0;
+            unsigned magnitude = value < 0 ? 0u - static_cast<unsigned>(value) : static_cast<unsigned>(value);
+            do
+            {
+                digits[size++] = static_cast<char>('0' + magnitude % 10);
+                magnitude /= 10;
+            } while (magnitude);
+            if (value < 0)
+            {
+                text += '-';
+            }
+            while (size)
+            {
+                text += digits[--size];
+            }
+        };
+
+        // The names, with a blank where the short name goes if there is none
+        auto append_names = [](std::string &text, const CommandLineOptionSpec &option) {
+            text += "  ";
+            if (option.short_name)
+            {
+                text += '-';
+                text += option.short_name;
+                text += option.long_name.empty() ? "" : ", ";
+            }
+            else
+            {
+                text += "    ";
+            }
+            if (!option.long_name.empty())
+            {
+                text += "--";
+                text += option.long_name;
+            }
+            if (option.has_value == HasValue::Required)
+            {
+                text += " <value>";
+            }
+            else if (option.has_value == HasValue::Optional)
+            {
+                text += " [<value>]";
+            }
+        };
+
+        // The help lines up after the longest names that fit
+        size_t column = 0;
+        std::string names;
+        for (const auto &option : options)
+        {
+            names.clear();
+            append_names(names, option);
+            column = std::max(column, std::min(names.size(), max_name_column));
+        }
+        column += 2;
+        size_t text_width = !width ? std::string::npos : width > column + min_text_width ? width - column : min_text_width;
+
+        std::string text;
+        for (const auto &option : options)
+        {
+            // The names, then the help in its column, or on the next line if they do not leave room
+            names.clear();
+            append_names(names, option);
+            out += names;
+            if (names.size() + 2 > column)
+            {
+                out += '\n';
+                out.append(column, ' ');
+            }
+            else
+            {
+                out.append(column - names.size(), ' ');
+            }
+
+            // The help, and how the option must be given
+            text.assign(option.help);
+            text += option.required ? " This option is required." : " This option is optional.";
+            if (option.has_value != HasValue::No)
+            {
+                text += option.required ? " This option " : " If this option occurs, then it ";
+                switch (option.occurs_type)
+                {
+                case Occurs::AtLeast:
+                    text += "must occur at least ";
+                    break;
+                case Occurs::AtMost:
+                    text += "must occur at most ";
+                    break;
+                case Occurs::Exactly:
+                    text += "must occur exactly ";
+                    break;
+                }
+                append_number(text, option.occurs_value);
+                text += " time(s).";
+                text += option.has_value == HasValue::Required ? " This option must have a value." : " This option may have a value.";
+            }
+
+            // Wrapped a word at a time, each line starting in the column
+            size_t used = 0;
+            for (size_t begin = 0; begin < text.size();)
+            {
+                size_t end = std::min(text.find(' ', begin), text.size());
+                size_t length = end - begin;
+                if (length)
+                {
+                    if (used && used + 1 + length > text_width)
+                    {
+                        out += '\n';
+                        out.append(column, ' ');
+                        used = 0;
+                    }
+                    else if (used)
+                    {
+                        out += ' ';
+                        used++;
+                    }
+                    out.append(text, begin, length);
+                    used += length;
+                }
+                begin = end + 1;
+            }
+            out += '\n';
+        }
+    };
+
+    /**
+     * Get the description of the options, as AppendUsage writes it UsageWidth wide. It is written once,
+     * so the parser is compiled if it has not been already.
+     *
+     * @return The description, valid while the parser is.
+     */
+    [[nodiscard]] std::string_view GetUsage();
+
     /**
      * Print the help data from the options to explain what we are wre expecting.
      *
      * @param argv Command line options
      */
     void PrintUsage(char * argv[]) const;
+
+    /**
+     * Print the help data from a description of the options, as AppendUsage writes it. The whole of it is
+     * put together first and written at once.
+     *
+     * @param argv    Command line options
+     * @param options The description of every option, empty if there are none.
+     */
+    static void PrintUsage(char * argv[], std::string_view options);
+
+    /**
+     * Get the width to wrap the usage to, so that it fits the terminal that it is printed on.
+     *
+     * @return The width of the standard error terminal, or COLUMNS, or UsageWidth if neither is known.
+     */
+    [[nodiscard]] static size_t TerminalWidth();
+};
+
+/**
+ * A command line parser whose options are fixed at compile time, as an array of CommandLineOptionSpec with
+ * static storage. The lookup tables and the usage text are built by the compiler, so there is nothing to
+ * set up at run time, and options are got at by their position, which is checked at compile time. Parse
+ * scans and validates the same way as CommandLine with the Native scanner, reading the same response
+ * files, environment and config files. The values are only kept as views, so they are valid while the
+ * arguments are, and until the next Parse if they came from a file.
+ *
+ * @tparam Options The options, such as a static constexpr std::array<CommandLineOptionSpec, N>.
+ */
+template <const auto &Options>
+class StaticCommandLine
+{
+public:
+    /**
+     * Number of options.
+     */
+    static constexpr size_t Size = std::size(Options);
+
+protected:
+    /**
+     * Position in Options of each short name, NoOption if not used.
+     */
+    static consteval std::array<size_t, 256> MakeShortIndex()
+    {
+        std::array<size_t, 256> index{};
+        index.fill(CommandLine::NoOption);
+        for (size_t i = 0; i < Size; i++)
+        {
+            if (Options[i].short_name)
+            {
+                index[static_cast<unsigned char>(Options[i].short_name)] = i;
+            }
+        }
+        return index;
+    };
+
+    /**
+     * Number of options that have a long name.
+     */
+    static consteval size_t CountLongNames()
+    {
+        return static_cast<size_t>(std::ranges::count_if(Options, [](const CommandLineOptionSpec &option) { return !option.long_name.empty(); }));
+    };
+
+    /**
+     * Positions in Options of the options that have a long name, sorted by it.
+     */
+    static consteval std::array<size_t, CountLongNames()> MakeLongOrder()
+    {
+        std::array<size_t, CountLongNames()> order{};
+        size_t size = 0;
+        for (size_t i = 0; i < Size; i++)
+        {
+            if (!Options[i].long_name.empty())
+            {
+                order[size++] = i;
+            }
+        }
+        std::ranges::sort(order, {}, [](size_t i) { return Options[i].long_name; });
+        return order;
+    };
+
+    /**
+     * Check that no two options share a name.
+     */
+    static consteval bool NamesAreUnique()
+    {
+        for (size_t i = 0; i < Size; i++)
+        {
+            for (size_t j = i + 1; j < Size; j++)
+            {
+                if ((Options[i].short_name && Options[i].short_name == Options[j].short_name) || (!Options[i].long_name.empty() && Options[i].long_name == Options[j].long_name))
+                {
+                    return false;
+                }
+            }
+        }
+        return true;
+    };
+
+    /**
+     * Describe every option, as PrintUsage does.
+     */
+    static constexpr std::string MakeUsageText()
+    {
+        std::string text;
+        CommandLine::AppendUsage(text, Options, CommandLine::UsageWidth);
+        return text;
+    };
+
+    /**
+     * The usage text, kept in an array so that it can outlive the compiler.
+     */
+    static consteval std::array<char, MakeUsageText().size()> MakeUsage()
+    {
+        std::array<char, MakeUsageText().size()> usage{};
+        std::ranges::copy(MakeUsageText(), usage.begin());
+        return usage;
+    };
+
+    static_assert(NamesAreUnique(), "two options have the same name");
+
+    static constexpr std::array<size_t, 256> short_index = MakeShortIndex();
+    static constexpr std::array<size_t, CountLongNames()> long_order = MakeLongOrder();
+    static constexpr std::array<char, MakeUsageText().size()> usage = MakeUsage();
+
+    std::array<CommandLineOptionState, Size> states{};
+    CommandLineArguments command_line; // The arguments with the response files read in
+    CommandLineArguments config;       // The arguments in the config files
+    std::string environment_prefix;    // Empty if the environment is not read
+    size_t config_option{CommandLine::NoOption}; // The option that names the config files
+    bool require_order; // Stop at the first operand, as POSIXLY_CORRECT asks, rather than looking past it
+    bool response_files{true};
+
+public:
+    StaticCommandLine() : require_order(std::getenv("POSIXLY_CORRECT") != nullptr) {};
+
+    /**
+     * Find an option by its long name.
+     *
+     * @param long_name The long name of the option. Fails to compile if there is no such option.
+     * @return          The position of the option, to get at it with.
+     */
+    static consteval size_t IndexOf(std::string_view long_name)
+    {
+        for (size_t i = 0; i < Size; i++)
+        {
+            if (Options[i].long_name == long_name)
+            {
+                return i;
+            }
+        }
+        throw "no option has this name";
+    };
+
+    /**
+     * Find a long option by its name, or by an abbreviation of it that no other name starts with.
+     *
+     * @param name What was typed.
+     * @return     The position of the option, or NoOption if there is none or the abbreviation could be
+     *             more than one.
+     */
+    static constexpr size_t FindLong(std::string_view name)
+    {
+        // Every name that starts with what was typed follows the place where it would go
+        auto i = std::ranges::lower_bound(long_order, name, {}, [](size_t option) { return Options[option].long_name; });
+        if (i == long_order.end() || !Options[*i].long_name.starts_with(name))
+        {
+            return CommandLine::NoOption;
+        }
+        if (Options[*i].long_name.size() == name.size())
+        {
+            return *i;
+        }
+        auto next = i + 1;
+        return next != long_order.end() && Options[*next].long_name.starts_with(name) ? CommandLine::NoOption : *i;
+    };
+
+    /**
+     * Find an option by its short name.
+     *
+     * @param short_name The short name of the option.
+     * @return           The position of the option, or NoOption if there is none.
+     */
+    static constexpr size_t FindShort(char short_name) { return short_index[static_cast<unsigned char>(short_name)]; };
+
+    /**
+     * Get the usage text of the options, UsageWidth wide, without the introduction that PrintUsage puts in
+     * front of it.
+     *
+     * @return The text, built at compile time.
+     */
+    static constexpr std::string_view Usage() { return { usage.data(), usage.size() }; };
+
+    /**
+     * Choose whether Parse reads the arguments in the response file named by an argument that starts with @.
+     * Any argument can name one, the value of an option too, so an argument that starts with @@ is taken
+     * as it is, less the first @.
+     *
+     * @param value True to read response files. If not set, then they are read.
+     *
+     * @see CommandLine::SetResponseFiles
+     */
+    void SetResponseFiles(bool value) { response_files = value; };
+
+    /**
+     * Have Parse take the options that the command line does not give from environment variables.
+     *
+     * @param prefix What every variable starts with. If not set, or empty, then the environment is not read.
+     *
+     * @see CommandLine::SetEnvironmentPrefix
+     */
+    void SetEnvironmentPrefix(std::string_view prefix) { environment_prefix = prefix; };
+
+    /**
+     * Have Parse read files of options, named by an option.
+     *
+     * @tparam Index The position of the option whose values are the files.
+     *
+     * @see CommandLine::SetConfigOption
+     */
+    template <size_t Index>
+    void SetConfigOption()
+    {
+        static_assert(Index < Size, "there is no option at this position");
+        static_assert(Options[Index].has_value != HasValue::No, "the option that names the config files must have a value");
+        config_option = Index;
+    };
+
+    /**
+     * Parse the command line arguments. Can be called any number of times, each call starts afresh.
+     *
+     * @param argc          The number of command line arguments.
+     * @param argv          The command line arguments.
+     * @param error_message Where problems with the parameters are described.
+     * @return              True if the command line arguments were parsed successfully, false otherwise.
+     */
+    bool Parse(int argc, char * argv[], std::stringstream &error_message)
+    {
+        // Forget the last command line
+        for (auto &state : states)
+        {
+            state.Clear();
+        }
+
+        // Extract the options
+        struct Lookup
+        {
+            StaticCommandLine &parser;
+
+            size_t FindShort(char name) const { return StaticCommandLine::FindShort(name); }
+            size_t FindLong(std::string_view name) const { return StaticCommandLine::FindLong(name); }
+            HasValue GetHasValue(size_t index) const { return Options[index].has_value; }
+            std::string_view GetLongName(size_t index) const { return Options[index].long_name; }
+            const CommandLineOptionState &GetState(size_t index) const { return parser.states[index]; }
+            void Store(size_t index, const char *value) { parser.states[index].Store(value, false); }
+        } lookup{ *this };
+        bool rc = true;
+        if (response_files)
+        {
+            rc = command_line.Expand(argc, argv, error_message);
+            CommandLine::Scan(command_line.Size(), command_line.Data(), require_order, lookup, error_message);
+        }
+        else
+        {
+            CommandLine::Scan(argc, argv, require_order, lookup, error_message);
+        }
+        rc = CommandLine::ScanDefaults(lookup, Size, environment_prefix, config_option, require_order, config, error_message) && rc;
+
+        // Validate the options read, reporting every problem
+        for (size_t i = 0; i < Size; i++)
+        {
+            const CommandLineOptionSpec &option = Options[i];
+            rc = states[i].Validate(option.long_name, option.required, option.occurs_type, option.occurs_value, option.type, error_message) && rc;
+        }
+        return rc;
+    };
+
+    /**
+     * Check if an option was given.
+     *
+     * @tparam Index The position of the option.
+     * @return       True if the option is present, false otherwise.
+     */
+    template <size_t Index>
+    [[nodiscard]] bool IsOptionValue() const
+    {
+        static_assert(Index < Size, "there is no option at this position");
+        return states[Index].count > 0;
+    };
+
+    /**
+     * Get the values of an option.
+     *
+     * @tparam Index The position of the option.
+     * @return       Views of the values, which are only valid while the parsed arguments are.
+     */
+    template <size_t Index>
+    [[nodiscard]] const CommandLineValueViews &GetOptionViews() const
+    {
+        static_assert(Index < Size, "there is no option at this position");
+        return states[Index].views;
+    };
+
+    /**
+     * Get a value of an option.
+     *
+     * @tparam Index The position of the option.
+     * @param value  Where the value goes. Left alone if the option was not given, so it can hold the
+     *               default beforehand.
+     * @param index  Which value, for options that occur more than once.
+     * @return       False if the value cannot be had as a T.
+     *
+     * @see CommandLineOptionState::GetValue
+     */
+    template <size_t Index, typename T>
+    bool GetOptionValue(T &value, size_t index = 0) const
+    {
+        static_assert(Index < Size, "there is no option at this position");
+        return states[Index].GetValue(Options[Index].type, value, index);
+    };
+
+    /**
+     * Print the help data from the options to explain what we are expecting.
+     *
+     * @param argv Command line options
+     */
+    void PrintUsage(char * argv[]) const
+    {
+        // The text built at compile time, unless the terminal is some other width
+        size_t width = CommandLine::TerminalWidth();
+        if (width == CommandLine::UsageWidth)
+        {
+            CommandLine::PrintUsage(argv, Usage());
+            return;
+        }
+        std::string text;
+        CommandLine::AppendUsage(text, Options, width);
+        CommandLine::PrintUsage(argv, text);
+    };
 };
 
 /*---------------------------------------------------------------------
@@ -0,0 +1,338 @@
+/* ********************************************************************
+   * Project   : Command line scanner equivalence test
+   * Author    : Simon Martin
+   * Copyright : LGPL v3
+   ********************************************************************
+
+    Modifications:
+    0.01 14/10/2026 Initial version.
+*/
+
+/*---------------------------------------------------------------------
+  -- compatibility
+  ---------------------------------------------------------------------*/
+
+/*---------------------------------------------------------------------
+  -- project includes (import)
+  ---------------------------------------------------------------------*/
+#include "CommandLine.h"
+
+/*---------------------------------------------------------------------
+  -- project includes (export)
+  ---------------------------------------------------------------------*/
+
+/*---------------------------------------------------------------------
+  -- C standard includes
+  ---------------------------------------------------------------------*/
+#ifdef __GLIBC__
+#include <getopt.h>
+#endif
+
+/*---------------------------------------------------------------------
+  -- C++ standard includes
+  ---------------------------------------------------------------------*/
+#include <array>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <limits>
+#include <random>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+/*---------------------------------------------------------------------
+  -- macros
+  ---------------------------------------------------------------------*/
+#define DEFAULT_CASES 20000
+#define DEFAULT_SEED 1
+#define MAX_ARGUMENTS 8
+#define RESPONSE_FILE "commandline_test.rsp"
+
+/*---------------------------------------------------------------------
+  -- forward declarations
+  ---------------------------------------------------------------------*/
+
+/*---------------------------------------------------------------------
+  -- data types
+  ---------------------------------------------------------------------*/
+/**
+ * What a parse came to: whether it worked, what it said, and every option's values.
+ */
+struct ParseResult {
+  bool ok;
+  std::string errors;
+  std::string values;
+
+  bool operator==(const ParseResult &) const = default;
+};
+
+/*---------------------------------------------------------------------
+  -- function prototypes
+  ---------------------------------------------------------------------*/
+
+/*---------------------------------------------------------------------
+  -- global variables
+  ---------------------------------------------------------------------*/
+
+/*---------------------------------------------------------------------
+  -- local variables
+  ---------------------------------------------------------------------*/
+// The test's own command line
+static constexpr std::array<CommandLineOptionSpec, 2> test_options{{
+    {"cases", 'c', false, HasValue::Required, Occurs::AtMost, 1, "Random command lines to parse. If not specified, then 20000.", CommandLineValueType::Integer(1, std::numeric_limits<int>::max())},
+    {"seed", 's', false, HasValue::Required, Occurs::AtMost, 1, "Where the random command lines start from, so that a failure can be repeated. If not specified, then 1.", CommandLineValueType::Integer(0, std::numeric_limits<uint32_t>::max())},
+}};
+using TestCommandLine = StaticCommandLine<test_options>;
+
+// Options with every kind of value, names that abbreviate to one another, and one without a short name
+static constexpr std::array<CommandLineOptionSpec, 6> scanned_options{{
+    {"port", 'p', false, HasValue::Required, Occurs::AtLeast, 0, "Port.", CommandLineValueType::Port()},
+    {"portal", 'P', false, HasValue::No, Occurs::AtLeast, 0, "Portal."},
+    {"idle-timeout", 't', false, HasValue::Required, Occurs::AtLeast, 0, "Idle timeout.", CommandLineValueType::Duration()},
+    {"no-echo", 'n', false, HasValue::No, Occurs::AtMost, 1, "No echo."},
+    {"level", 'l', false, HasValue::Optional, Occurs::AtLeast, 0, "Level."},
+    {"log", '\0', false, HasValue::Required, Occurs::AtLeast, 0, "Log."},
+}};
+using ScannedCommandLine = StaticCommandLine<scanned_options>;
+
+// What the command lines are made of: options found whole, abbreviated, grouped, unknown and misused
+static constexpr std::string_view words[] = {
+    "-p", "1", "foo", "--port=2", "-np3", "--idle", "7", "7s", "--level", "--level=x", "-lv", "-l", "--bad", "-z", "-zn",
+    "-nz", "--", "-", "--por", "--port", "--portal", "--portal=1", "--lo", "--log", "--l", "-nn", "-tP", "-:", "--no-echo=",
+    "--=", "-p70000", "-t1m",
+};
+
+/*---------------------------------------------------------------------
+  -- private functions
+  ---------------------------------------------------------------------*/
+static void append_views(std::string &values, std::string_view name, bool given, const CommandLineValueViews &views) {
+  values += name;
+  values += given ? "+" : "-";
+  for (size_t i = 0; i < views.Size(); i++) {
+    values += '[';
+    values += views[i];
+    values += ']';
+  }
+  values += ' ';
+}
+
+static ParseResult parse_runtime(std::vector<char *> argv, CommandLineScanner scanner) {
+  // The arguments are a copy, in case the scanner moves them about
+  CommandLine parser{scanned_options};
+  parser.SetScanner(scanner);
+  std::stringstream error_message;
+  ParseResult result{};
+  result.ok = parser.Parse(static_cast<int>(argv.size()) - 1, argv.data(), error_message);
+  result.errors = error_message.str();
+  for (const auto &option : scanned_options) {
+    append_views(result.values, option.long_name, parser.IsOptionValue(option.long_name), parser.GetOptionViews(option.long_name));
+  }
+  return result;
+}
+
+template <size_t... Index>
+static ParseResult parse_static(std::vector<char *> argv, std::index_sequence<Index...>) {
+  ScannedCommandLine parser;
+  std::stringstream error_message;
+  ParseResult result{};
+  result.ok = parser.Parse(static_cast<int>(argv.size()) - 1, argv.data(), error_message);
+  result.errors = error_message.str();
+  (append_views(result.values, scanned_options[Index].long_name, parser.IsOptionValue<Index>(), parser.GetOptionViews<Index>()), ...);
+  return result;
+}
+
+#ifdef __GLIBC__
+static std::string parse_libc(std::vector<char *> argv) {
+  // The options as the C library's getopt_long takes them, long ones returned as 256 plus their position
+  std::string short_options;
+  std::vector<option> long_options;
+  for (size_t i = 0; i < scanned_options.size(); i++) {
+    const auto &spec = scanned_options[i];
+    int has_arg = spec.has_value == HasValue::Required ? required_argument : spec.has_value == HasValue::Optional ? optional_argument : no_argument;
+    if (spec.short_name) {
+      short_options += spec.short_name;
+      short_options += has_arg == required_argument ? ":" : has_arg == optional_argument ? "::" : "";
+    }
+    long_options.push_back({spec.long_name.data(), has_arg, nullptr, 256 + static_cast<int>(i)});
+  }
+  long_options.push_back({});
+
+  // Start again from scratch, which also reads POSIXLY_CORRECT again, and keep quiet about errors
+  optind = 0;
+  opterr = 0;
+  std::array<int, scanned_options.size()> counts{};
+  std::array<std::string, scanned_options.size()> values;
+  for (int c; (c = getopt_long(static_cast<int>(argv.size()) - 1, argv.data(), short_options.c_str(), long_options.data(), nullptr)) != -1;) {
+    size_t index = c >= 256 ? static_cast<size_t>(c - 256) : c == '?' || c == ':' ? CommandLine::NoOption : ScannedCommandLine::FindShort(static_cast<char>(c));
+    if (index == CommandLine::NoOption) {
+      continue;
+    }
+    counts[index]++;
+    if (optarg) {
+      values[index] += '[';
+      values[index] += optarg;
+      values[index] += ']';
+    }
+  }
+
+  // Written the way that append_views writes them
+  std::string result;
+  for (size_t i = 0; i < scanned_options.size(); i++) {
+    result += scanned_options[i].long_name;
+    result += counts[i] ? "+" : "-";
+    result += values[i];
+    result += ' ';
+  }
+  return result;
+}
+#endif
+
+static bool is_short_option(char c) {
+  return c != ':' && ScannedCommandLine::FindShort(c) != CommandLine::NoOption;
+}
+
+static bool names_unknown_in_group(const std::vector<char *> &argv) {
+  // An unknown short option grouped with others, such as -zn or -nz. The native scanners name the argument
+  // that it is in, where getopt names whichever argument it had got to, which can even be the program name.
+  // One after -- is counted too, as that -- may have been the value of an option
+  for (size_t i = 1; argv[i]; i++) {
+    std::string_view argument = argv[i];
+    if (argument.size() < 3 || argument[0] != '-' || argument[1] == '-') {
+      continue;
+    }
+    for (size_t j = 1; j < argument.size(); j++) {
+      if (!is_short_option(argument[j])) {
+        return true;
+      }
+      if (scanned_options[ScannedCommandLine::FindShort(argument[j])].has_value != HasValue::No) {
+        break;
+      }
+    }
+  }
+  return false;
+}
+
+static void drop_unknown(std::string &errors) {
+  // Everything that was said, except for which arguments were not known
+  std::istringstream lines{errors};
+  std::string kept;
+  for (std::string line; std::getline(lines, line);) {
+    if (!line.starts_with("Error: Unknown option")) {
+      kept += line;
+      kept += '\n';
+    }
+  }
+  errors = kept;
+}
+
+static void print_result(std::string_view scanner, const ParseResult &result) {
+  std::cerr << "  " << scanner << ": ok=" << result.ok << " " << result.values << std::endl;
+  std::cerr << result.errors;
+}
+
+static int check_response_files() {
+  // A response file among the options, with @@ standing for a @ in it, and on the command line where it is
+  // the value of an option
+  std::ofstream{RESPONSE_FILE} << "--log \"a b\" --log @@x # not an argument\n-p 5\n";
+  static char program[] = "test";
+  static char file[] = "--log=x";
+  static char response[] = "@" RESPONSE_FILE;
+  static char log[] = "--log";
+  static char literal[] = "@@literal";
+  static char at[] = "@@";
+  static char missing[] = "@" RESPONSE_FILE ".missing";
+  std::vector<char *> found{program, file, response, log, literal, log, at, nullptr};
+  std::vector<char *> lost{program, missing, nullptr};
+  const ParseResult expected_found{true, "", "port+[5] portal- idle-timeout- no-echo- level- log+[x][a b][@x][@literal][@] "};
+  const ParseResult expected_lost{false, "Error: failed to open " RESPONSE_FILE ".missing: No such file or directory\n", "port- portal- idle-timeout- no-echo- level- log- "};
+
+  int failures = 0;
+  for (const auto &[arguments, expected] : {std::pair{found, expected_found}, std::pair{lost, expected_lost}}) {
+    for (const auto &[scanner, result] : {
+      std::pair<std::string_view, ParseResult>{"getopt", parse_runtime(arguments, CommandLineScanner::Getopt)},
+      std::pair<std::string_view, ParseResult>{"native", parse_runtime(arguments, CommandLineScanner::Native)},
+      std::pair<std::string_view, ParseResult>{"static", parse_static(arguments, std::make_index_sequence<scanned_options.size()>{})},
+    }) {
+      if (result != expected) {
+        std::cerr << "Response files misread by " << scanner << std::endl;
+        print_result("expected", expected);
+        print_result("got", result);
+        failures++;
+      }
+    }
+  }
+  std::remove(RESPONSE_FILE);
+  return failures;
+}
+
+/*---------------------------------------------------------------------
+  -- public functions
+  ---------------------------------------------------------------------*/
+
+int main(int argc, char *argv[]) {
+  // Get the parameters
+  TestCommandLine cmd_run;
+  if (std::stringstream error_message; !cmd_run.Parse(argc, argv, error_message)) {
+    std::cerr << error_message.str() << std::endl;
+    cmd_run.PrintUsage(argv);
+    return 1;
+  }
+  int cases = DEFAULT_CASES;
+  int64_t seed = DEFAULT_SEED;
+  cmd_run.GetOptionValue<TestCommandLine::IndexOf("cases")>(cases);
+  cmd_run.GetOptionValue<TestCommandLine::IndexOf("seed")>(seed);
+
+  // Response files are read the same way whichever scanner reads the arguments
+  int misread = check_response_files();
+
+  // Every scanner has to come to the same values, counts and errors as getopt_long_r does, and it to the same
+  // values and counts as the C library, where there is one to compare with
+  std::mt19937 random(static_cast<uint32_t>(seed));
+  int failures = 0;
+  for (int i = 0; i < cases; i++) {
+    static char program[] = "test";
+    std::vector<std::string> arguments(1 + random() % MAX_ARGUMENTS);
+    std::vector<char *> scanned{program};
+    for (auto &argument : arguments) {
+      argument = words[random() % std::size(words)];
+      scanned.push_back(argument.data());
+    }
+    scanned.push_back(nullptr);
+
+    ParseResult getopt = parse_runtime(scanned, CommandLineScanner::Getopt);
+    ParseResult native = parse_runtime(scanned, CommandLineScanner::Native);
+    ParseResult fixed = parse_static(scanned, std::make_index_sequence<scanned_options.size()>{});
+    if (names_unknown_in_group(scanned)) {
+      drop_unknown(getopt.errors);
+      drop_unknown(native.errors);
+      drop_unknown(fixed.errors);
+    }
+    bool same = native == getopt && fixed == getopt;
+#ifdef __GLIBC__
+    // And getopt_long_r has to find the same options and values as the C library's getopt_long
+    std::string libc = parse_libc(scanned);
+    same = same && libc == getopt.values;
+#endif
+    if (!same) {
+      std::cerr << "Scanners differ on:";
+      for (size_t j = 1; scanned[j]; j++) {
+        std::cerr << " " << scanned[j];
+      }
+      std::cerr << std::endl;
+      print_result("getopt", getopt);
+      print_result("native", native);
+      print_result("static", fixed);
+#ifdef __GLIBC__
+      std::cerr << "  libc: " << libc << std::endl;
+#endif
+      failures++;
+    }
+  }
+  std::cout << cases - failures << " of " << cases << " command lines scanned the same" << std::endl;
+  return failures || misread ? 1 : 0;
+}
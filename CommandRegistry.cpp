@@ -0,0 +1,188 @@
+/* ********************************************************************
+   * Project   : Command registry
+   * Author    : Simon Martin
+   * Copyright : LGPL v3
+   ********************************************************************
+
+    Modifications:
+    0.01 14/10/2026 Initial version.
+*/
+
+/*---------------------------------------------------------------------
+  -- compatibility
+  ---------------------------------------------------------------------*/
+
+/*---------------------------------------------------------------------
+  -- project includes (import)
+  ---------------------------------------------------------------------*/
+
+/*---------------------------------------------------------------------
+  -- project includes (export)
+  ---------------------------------------------------------------------*/
+#include "CommandRegistry.h"
+
+/*---------------------------------------------------------------------
+  -- C standard includes
+  ---------------------------------------------------------------------*/
+
+/*---------------------------------------------------------------------
+  -- C++ standard includes
+  ---------------------------------------------------------------------*/
+#include <algorithm>
+#include <array>
+#include <format>
+#include <iterator>
+
+/*---------------------------------------------------------------------
+  -- macros
+  ---------------------------------------------------------------------*/
+
+/*---------------------------------------------------------------------
+  -- forward declarations
+  ---------------------------------------------------------------------*/
+
+/*---------------------------------------------------------------------
+  -- data types
+  ---------------------------------------------------------------------*/
+
+/*---------------------------------------------------------------------
+  -- function prototypes
+  ---------------------------------------------------------------------*/
+
+/*---------------------------------------------------------------------
+  -- global variables
+  ---------------------------------------------------------------------*/
+
+/*---------------------------------------------------------------------
+  -- local variables
+  ---------------------------------------------------------------------*/
+
+/*---------------------------------------------------------------------
+  -- private functions
+  ---------------------------------------------------------------------*/
+static constexpr char toupper_ascii(char chr)
+{
+    return chr >= 'a' && chr <= 'z' ? static_cast<char>(chr - 'a' + 'A') : chr;
+}
+
+static constexpr int compare_nocase(std::string_view token, std::string_view name)
+{
+    // Command names are stored in upper case, so only the token needs converting. Compared as unsigned, as
+    // std::string compares, whatever the signedness of char
+    for (size_t i = 0; i < std::min(token.size(), name.size()); i++)
+    {
+        auto chr = static_cast<unsigned char>(toupper_ascii(token[i]));
+        if (auto stored = static_cast<unsigned char>(name[i]); chr != stored)
+        {
+            return chr < stored ? -1 : 1;
+        }
+    }
+    return token.size() == name.size() ? 0 : (token.size() < name.size() ? -1 : 1);
+}
+
+static std::string_view next_word(std::string_view line, size_t &position)
+{
+    // Skip the separators
+    position = line.find_first_not_of(' ', position);
+    if (position == std::string_view::npos)
+    {
+        return {};
+    }
+
+    // A quoted word runs to the closing quote, or the end of the line
+    size_t start = position;
+    char terminator = ' ';
+    if (line[position] == '"')
+    {
+        terminator = '"';
+        start++;
+    }
+    size_t end = line.find(terminator, start);
+    std::string_view word = line.substr(start, end - start);
+
+    // Carry on after the terminator
+    position = end == std::string_view::npos ? end : end + 1;
+    return word;
+}
+
+/*---------------------------------------------------------------------
+  -- public functions
+  ---------------------------------------------------------------------*/
+
+bool CommandRegistry::Add(std::string_view name, std::string_view help, CommandHandler handler, bool blocking)
+{
+    if (frozen || name.empty())
+    {
+        return false;
+    }
+
+    // Store the name in upper case so that lookups only have to convert what was typed
+    std::string upper_name{name};
+    std::ranges::transform(upper_name, upper_name.begin(), toupper_ascii);
+    if (std::ranges::find(commands, upper_name, &CommandEntry::name) != commands.end())
+    {
+        return false;
+    }
+
+    commands.push_back({ .name = std::move(upper_name), .help = std::string{help}, .handler = std::move(handler), .blocking = blocking });
+    return true;
+}
+
+void CommandRegistry::Freeze()
+{
+    if (frozen)
+    {
+        return;
+    }
+
+    // Sort once, in the order that Find searches in, and keep the names together so that the search touches
+    // as little memory as possible
+    std::ranges::sort(commands, [](std::string_view left, std::string_view right) { return compare_nocase(left, right) < 0; }, &CommandEntry::name);
+    names.reserve(commands.size());
+    for (const auto &command : commands)
+    {
+        names.emplace_back(command.name);
+    }
+    frozen = true;
+}
+
+const CommandEntry *CommandRegistry::Find(std::string_view name) const
+{
+    auto i = std::ranges::lower_bound(names, name, [](std::string_view value, std::string_view token) {
+        return compare_nocase(token, value) > 0;
+    });
+    return i != names.end() && compare_nocase(name, *i) == 0 ? &commands[i - names.begin()] : nullptr;
+}
+
+const CommandEntry *CommandRegistry::Match(std::string_view line) const
+{
+    size_t position = 0;
+    return Find(next_word(line, position));
+}
+
+const CommandEntry *CommandRegistry::Execute(std::string_view line, CommandOutput &out) const
+{
+    // Find the command
+    size_t position = 0;
+    const CommandEntry *command = Find(next_word(line, position));
+    if (!command)
+    {
+        return nullptr;
+    }
+
+    // Collect the arguments without copying them
+    std::array<std::string_view, MaxArguments> args;
+    size_t count = 0;
+    while ((position = line.find_first_not_of(' ', position)) != std::string_view::npos)
+    {
+        if (count == args.size())
+        {
+            std::format_to(std::back_inserter(out), "Error: too many arguments, at most {} allowed\n", MaxArguments);
+            return command;
+        }
+        args[count++] = next_word(line, position);
+    }
+
+    command->handler(CommandArguments{args.data(), count}, out);
+    return command;
+}
@@ -0,0 +1,172 @@
+/* ********************************************************************
+   * Project   : Command registry
+   * Author    : Simon Martin
+   ********************************************************************
+
+    Modifications:
+    0.01 14/10/2026 Initial version.
+*/
+
+#pragma once
+
+/*---------------------------------------------------------------------
+  -- compatibility
+  ---------------------------------------------------------------------*/
+
+/*---------------------------------------------------------------------
+  -- project includes (import)
+  ---------------------------------------------------------------------*/
+
+/*---------------------------------------------------------------------
+  -- project includes (export)
+  ---------------------------------------------------------------------*/
+
+/*---------------------------------------------------------------------
+  -- C standard includes
+  ---------------------------------------------------------------------*/
+
+/*---------------------------------------------------------------------
+  -- C++ standard includes
+  ---------------------------------------------------------------------*/
+#include <functional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/*---------------------------------------------------------------------
+  -- macros
+  ---------------------------------------------------------------------*/
+
+/*---------------------------------------------------------------------
+  -- forward declarations
+  ---------------------------------------------------------------------*/
+
+/*---------------------------------------------------------------------
+  -- data types
+  ---------------------------------------------------------------------*/
+/**
+ * The words following the command name on the line. The views point into the line being executed,
+ * so they are only valid while the handler runs.
+ */
+using CommandArguments = std::span<const std::string_view>;
+
+/**
+ * Where a command writes its response. This is the connection's own output buffer, so handlers must
+ * only append to it, with += or std::format_to(std::back_inserter(out), ...).
+ */
+using CommandOutput = std::string;
+
+/**
+ * Function called when a command is typed.
+ */
+using CommandHandler = std::function<void(CommandArguments args, CommandOutput &out)>;
+
+struct CommandEntry
+{
+    std::string name;
+    std::string help;
+    CommandHandler handler;
+    bool blocking; // May take a while, so should be kept off threads that serve other connections
+};
+
+/**
+ * The commands that a client can type. Commands are added at startup and then the registry is frozen,
+ * after which it is read only and can be used from any number of threads without locking.
+ *
+ * Names are matched without regard to case. A line is split into words on spaces, and a word may be
+ * enclosed in double quotes to include spaces. The first word is the command and the rest are its
+ * arguments.
+ */
+class CommandRegistry
+{
+protected:
+    std::vector<CommandEntry> commands;
+    std::vector<std::string_view> names; // Upper case names, in the same order as commands
+    bool frozen{false};
+
+public:
+    /**
+     * Most arguments that a command can be given.
+     */
+    static constexpr size_t MaxArguments = 32;
+
+    CommandRegistry() = default;
+    virtual ~CommandRegistry() = default;
+
+    /**
+     * Add a command. All commands must be added before calling Freeze.
+     *
+     * @param name     The name typed to run the command.
+     * @param help     A help string that describes the command.
+     * @param handler  Function called to run the command.
+     * @param blocking True if the command may take a while, so that the server runs it somewhere it only
+     *                 holds up the client that typed it.
+     * @return         False if the registry is frozen or the name is empty or already used.
+     */
+    bool Add(std::string_view name, std::string_view help, CommandHandler handler, bool blocking = false);
+
+    /**
+     * Build the lookup table. No more commands can be added after this.
+     */
+    void Freeze();
+
+    /**
+     * Check if the registry has been frozen.
+     *
+     * @return True if Freeze has been called.
+     */
+    [[nodiscard]] bool IsFrozen() const { return frozen; };
+
+    /**
+     * Get the commands. Sorted by name once frozen.
+     *
+     * @return The commands.
+     */
+    [[nodiscard]] const std::vector<CommandEntry> &Commands() const { return commands; };
+
+    /**
+     * Find a command by its name. Only valid once frozen.
+     *
+     * @param name The name of the command, in any case.
+     * @return     The command, or nullptr if not found.
+     */
+    [[nodiscard]] const CommandEntry *Find(std::string_view name) const;
+
+    /**
+     * Find the command that a line names, without running it. Only valid once frozen.
+     *
+     * @param line The line typed by the client.
+     * @return     The command, or nullptr if the line is empty or the command does not exist.
+     */
+    [[nodiscard]] const CommandEntry *Match(std::string_view line) const;
+
+    /**
+     * Split a line into words and run the command that it names. Only valid once frozen.
+     *
+     * @param line The line typed by the client.
+     * @param out  Where the command appends its response.
+     * @return     The command that was run, or nullptr if the line is empty or the command does not exist.
+     */
+    const CommandEntry *Execute(std::string_view line, CommandOutput &out) const;
+};
+
+/*---------------------------------------------------------------------
+  -- function prototypes
+  ---------------------------------------------------------------------*/
+
+/*---------------------------------------------------------------------
+  -- global variables
+  ---------------------------------------------------------------------*/
+
+/*---------------------------------------------------------------------
+  -- local variables
+  ---------------------------------------------------------------------*/
+
+/*---------------------------------------------------------------------
+  -- private functions
+  ---------------------------------------------------------------------*/
+
+/*---------------------------------------------------------------------
+  -- public functions
+  ---------------------------------------------------------------------*/
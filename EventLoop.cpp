@@ -0,0 +1,426 @@
+/* ********************************************************************
+   * Project   : Event loop
+   * Author    : Simon Martin
+   * Copyright : LGPL v3
+   ********************************************************************
+
+    Modifications:
+    0.01 14/10/2026 Initial version.
+*/
+
+/*---------------------------------------------------------------------
+  -- compatibility
+  ---------------------------------------------------------------------*/
+
+/*---------------------------------------------------------------------
+  -- project includes (import)
+  ---------------------------------------------------------------------*/
+
+/*---------------------------------------------------------------------
+  -- project includes (export)
+  ---------------------------------------------------------------------*/
+#include "EventLoop.h"
+
+/*---------------------------------------------------------------------
+  -- C standard includes
+  ---------------------------------------------------------------------*/
+#if defined(CLI_EVENT_LOOP_BACKEND_EPOLL)
+#include <sys/epoll.h>
+#elif defined(CLI_EVENT_LOOP_BACKEND_KQUEUE)
+#include <sys/types.h>
+#include <sys/event.h>
+#include <sys/time.h>
+#else
+#include <sys/select.h>
+#endif
+#if defined(__linux__)
+#include <sys/eventfd.h>
+#endif
+#include <unistd.h>
+#include <fcntl.h>
+#include <cerrno>
+#include <cstdint>
+
+/*---------------------------------------------------------------------
+  -- C++ standard includes
+  ---------------------------------------------------------------------*/
+#include <algorithm>
+#include <array>
+
+/*---------------------------------------------------------------------
+  -- macros
+  ---------------------------------------------------------------------*/
+#define MAX_EVENTS 64
+
+/*---------------------------------------------------------------------
+  -- forward declarations
+  ---------------------------------------------------------------------*/
+
+/*---------------------------------------------------------------------
+  -- data types
+  ---------------------------------------------------------------------*/
+
+/*---------------------------------------------------------------------
+  -- function prototypes
+  ---------------------------------------------------------------------*/
+
+/*---------------------------------------------------------------------
+  -- global variables
+  ---------------------------------------------------------------------*/
+
+/*---------------------------------------------------------------------
+  -- local variables
+  ---------------------------------------------------------------------*/
+
+/*---------------------------------------------------------------------
+  -- private functions
+  ---------------------------------------------------------------------*/
+
+/*---------------------------------------------------------------------
+  -- public functions
+  ---------------------------------------------------------------------*/
+
+#if defined(CLI_EVENT_LOOP_BACKEND_EPOLL)
+
+EventLoop::EventLoop()
+{
+    handle = epoll_create1(EPOLL_CLOEXEC);
+}
+
+EventLoop::~EventLoop()
+{
+    if (handle != -1)
+    {
+        close(handle);
+    }
+}
+
+const char *EventLoop::Backend()
+{
+    return "epoll";
+}
+
+bool EventLoop::Add(int fd, bool exclusive)
+{
+    struct epoll_event event{};
+    event.events = EPOLLIN;
+#ifdef EPOLLEXCLUSIVE
+    if (exclusive)
+    {
+        // Avoid the thundering herd when several loops share a listening socket
+        event.events |= EPOLLEXCLUSIVE;
+    }
+    else
+#else
+    (void)exclusive;
+#endif
+    {
+        // Report a half closed connection as a hang up, it cannot be combined with EPOLLEXCLUSIVE
+        event.events |= EPOLLRDHUP;
+    }
+    event.data.fd = fd;
+
+    return epoll_ctl(handle, EPOLL_CTL_ADD, fd, &event) == 0;
+}
+
+bool EventLoop::Modify(int fd, bool readable, bool writable, bool hangup)
+{
+    struct epoll_event event{};
+    if (hangup)
+    {
+        event.events |= EPOLLRDHUP;
+    }
+    if (readable)
+    {
+        event.events |= EPOLLIN;
+    }
+    if (writable)
+    {
+        event.events |= EPOLLOUT;
+    }
+    event.data.fd = fd;
+
+    return epoll_ctl(handle, EPOLL_CTL_MOD, fd, &event) == 0;
+}
+
+bool EventLoop::Remove(int fd)
+{
+    return epoll_ctl(handle, EPOLL_CTL_DEL, fd, nullptr) == 0;
+}
+
+int EventLoop::Wait(std::vector<EventLoopEvent> &events, int timeout_ms)
+{
+    std::array<struct epoll_event, MAX_EVENTS> ready{};
+
+    events.clear();
+    int count = epoll_wait(handle, ready.data(), static_cast<int>(ready.size()), timeout_ms);
+    for (int i = 0; i < count; i++)
+    {
+        events.push_back({
+            .fd = ready[i].data.fd,
+            .readable = (ready[i].events & (EPOLLIN | EPOLLPRI)) != 0,
+            .writable = (ready[i].events & EPOLLOUT) != 0,
+            .hangup = (ready[i].events & (EPOLLHUP | EPOLLERR | EPOLLRDHUP)) != 0,
+        });
+    }
+
+    return count;
+}
+
+#elif defined(CLI_EVENT_LOOP_BACKEND_KQUEUE)
+
+EventLoop::EventLoop()
+{
+    handle = kqueue();
+}
+
+EventLoop::~EventLoop()
+{
+    if (handle != -1)
+    {
+        close(handle);
+    }
+}
+
+const char *EventLoop::Backend()
+{
+    return "kqueue";
+}
+
+bool EventLoop::Add(int fd, bool exclusive)
+{
+    // kqueue has no exclusive wake up, the losers of the race simply see EAGAIN from accept
+    (void)exclusive;
+
+    struct kevent change{};
+    EV_SET(&change, fd, EVFILT_READ, EV_ADD | EV_ENABLE, 0, 0, nullptr);
+
+    return kevent(handle, &change, 1, nullptr, 0, nullptr) == 0;
+}
+
+bool EventLoop::Modify(int fd, bool readable, bool writable, bool hangup)
+{
+    // The end of the input is only reported by the read filter, so it goes with reading
+    (void)hangup;
+
+    std::array<struct kevent, 2> changes{};
+    EV_SET(&changes[0], fd, EVFILT_READ, EV_ADD | (readable ? EV_ENABLE : EV_DISABLE), 0, 0, nullptr);
+    EV_SET(&changes[1], fd, EVFILT_WRITE, EV_ADD | (writable ? EV_ENABLE : EV_DISABLE), 0, 0, nullptr);
+
+    return kevent(handle, changes.data(), static_cast<int>(changes.size()), nullptr, 0, nullptr) == 0;
+}
+
+bool EventLoop::Remove(int fd)
+{
+    struct kevent change{};
+    EV_SET(&change, fd, EVFILT_READ, EV_DELETE, 0, 0, nullptr);
+    bool rc = kevent(handle, &change, 1, nullptr, 0, nullptr) == 0;
+
+    // The write filter only exists if Modify was called, so it is fine if it is not there
+    EV_SET(&change, fd, EVFILT_WRITE, EV_DELETE, 0, 0, nullptr);
+    kevent(handle, &change, 1, nullptr, 0, nullptr);
+
+    return rc;
+}
+
+int EventLoop::Wait(std::vector<EventLoopEvent> &events, int timeout_ms)
+{
+    std::array<struct kevent, MAX_EVENTS> ready{};
+    struct timespec timeout{
+        .tv_sec = timeout_ms / 1000,
+        .tv_nsec = (timeout_ms % 1000) * 1000000L,
+    };
+
+    events.clear();
+    int count = kevent(handle, nullptr, 0, ready.data(), static_cast<int>(ready.size()), timeout_ms < 0 ? nullptr : &timeout);
+    for (int i = 0; i < count; i++)
+    {
+        events.push_back({
+            .fd = static_cast<int>(ready[i].ident),
+            .readable = ready[i].filter == EVFILT_READ,
+            .writable = ready[i].filter == EVFILT_WRITE,
+            .hangup = (ready[i].flags & (EV_EOF | EV_ERROR)) != 0,
+        });
+    }
+
+    return count;
+}
+
+#else
+
+EventLoop::EventLoop() = default;
+
+EventLoop::~EventLoop() = default;
+
+const char *EventLoop::Backend()
+{
+    return "select";
+}
+
+bool EventLoop::Add(int fd, bool exclusive)
+{
+    (void)exclusive;
+
+    // select can only watch descriptors below FD_SETSIZE
+    if ((fd < 0) || (fd >= FD_SETSIZE))
+    {
+        errno = EINVAL;
+        return false;
+    }
+
+    fds.push_back({ .fd = fd, .readable = true, .writable = false });
+    return true;
+}
+
+bool EventLoop::Modify(int fd, bool readable, bool writable, bool hangup)
+{
+    // select cannot see a hang up, only the end of the input when reading
+    (void)hangup;
+
+    auto i = std::ranges::find(fds, fd, &Interest::fd);
+    if (i == fds.end())
+    {
+        errno = ENOENT;
+        return false;
+    }
+
+    i->readable = readable;
+    i->writable = writable;
+    return true;
+}
+
+bool EventLoop::Remove(int fd)
+{
+    auto i = std::ranges::find(fds, fd, &Interest::fd);
+    if (i == fds.end())
+    {
+        errno = ENOENT;
+        return false;
+    }
+
+    // Order does not matter, so swap with the last one rather than shuffling the vector
+    *i = fds.back();
+    fds.pop_back();
+    return true;
+}
+
+int EventLoop::Wait(std::vector<EventLoopEvent> &events, int timeout_ms)
+{
+    fd_set recv_fds;
+    fd_set send_fds;
+    FD_ZERO(&recv_fds);
+    FD_ZERO(&send_fds);
+    int max_fd = -1;
+    for (const auto &interest : fds)
+    {
+        if (interest.readable)
+        {
+            FD_SET(interest.fd, &recv_fds);
+        }
+        if (interest.writable)
+        {
+            FD_SET(interest.fd, &send_fds);
+        }
+        max_fd = std::max(max_fd, interest.fd);
+    }
+    struct timeval timeout{
+        .tv_sec = timeout_ms / 1000,
+        .tv_usec = (timeout_ms % 1000) * 1000,
+    };
+
+    events.clear();
+    int count = select(max_fd + 1, &recv_fds, &send_fds, nullptr, timeout_ms < 0 ? nullptr : &timeout);
+    if (count <= 0)
+    {
+        return count;
+    }
+
+    // A descriptor ready in both sets is counted twice by select, but is only one event
+    for (const auto &interest : fds)
+    {
+        bool readable = FD_ISSET(interest.fd, &recv_fds);
+        bool writable = FD_ISSET(interest.fd, &send_fds);
+        if (readable || writable)
+        {
+            events.push_back({ .fd = interest.fd, .readable = readable, .writable = writable, .hangup = false });
+        }
+    }
+
+    return static_cast<int>(events.size());
+}
+
+#endif
+
+bool EventLoop::IsOpen() const
+{
+#if defined(CLI_EVENT_LOOP_BACKEND_SELECT)
+    return true;
+#else
+    return handle != -1;
+#endif
+}
+
+#if defined(__linux__)
+
+EventLoopWakeup::EventLoopWakeup()
+{
+    read_fd = write_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+}
+
+EventLoopWakeup::~EventLoopWakeup()
+{
+    if (read_fd != -1)
+    {
+        close(read_fd);
+    }
+}
+
+#else
+
+EventLoopWakeup::EventLoopWakeup()
+{
+    int fds[2];
+    if (pipe(fds) == -1)
+    {
+        return;
+    }
+
+    // Neither end may block, a full pipe already means that the waiters will wake up
+    for (int fd : fds)
+    {
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+        fcntl(fd, F_SETFD, FD_CLOEXEC);
+    }
+    read_fd = fds[0];
+    write_fd = fds[1];
+}
+
+EventLoopWakeup::~EventLoopWakeup()
+{
+    if (read_fd != -1)
+    {
+        close(read_fd);
+        close(write_fd);
+    }
+}
+
+#endif
+
+bool EventLoopWakeup::Signal() const
+{
+    uint64_t value = 1;
+    if (write(write_fd, &value, sizeof(value)) == -1)
+    {
+        // If the counter or pipe is full then it is already readable
+        return errno == EAGAIN;
+    }
+
+    return true;
+}
+
+void EventLoopWakeup::Clear() const
+{
+    uint64_t value;
+    while (read(read_fd, &value, sizeof(value)) > 0)
+        ;
+}
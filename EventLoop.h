@@ -0,0 +1,208 @@
+/* ********************************************************************
+   * Project   : Event loop
+   * Author    : Simon Martin
+   ********************************************************************
+
+    Modifications:
+    0.01 14/10/2026 Initial version.
+*/
+
+#pragma once
+
+/*---------------------------------------------------------------------
+  -- compatibility
+  ---------------------------------------------------------------------*/
+#if defined(CLI_EVENT_LOOP_SELECT)
+#define CLI_EVENT_LOOP_BACKEND_SELECT 1
+#elif defined(__linux__)
+#define CLI_EVENT_LOOP_BACKEND_EPOLL 1
+#elif defined(__APPLE__) || defined(__FreeBSD__) || defined(__OpenBSD__) || defined(__NetBSD__) || defined(__DragonFly__)
+#define CLI_EVENT_LOOP_BACKEND_KQUEUE 1
+#else
+#define CLI_EVENT_LOOP_BACKEND_SELECT 1
+#endif
+
+/*---------------------------------------------------------------------
+  -- project includes (import)
+  ---------------------------------------------------------------------*/
+
+/*---------------------------------------------------------------------
+  -- project includes (export)
+  ---------------------------------------------------------------------*/
+
+/*---------------------------------------------------------------------
+  -- C standard includes
+  ---------------------------------------------------------------------*/
+
+/*---------------------------------------------------------------------
+  -- C++ standard includes
+  ---------------------------------------------------------------------*/
+#include <vector>
+
+/*---------------------------------------------------------------------
+  -- macros
+  ---------------------------------------------------------------------*/
+
+/*---------------------------------------------------------------------
+  -- forward declarations
+  ---------------------------------------------------------------------*/
+
+/*---------------------------------------------------------------------
+  -- data types
+  ---------------------------------------------------------------------*/
+/**
+ * A readiness notification for a single file descriptor.
+ */
+struct EventLoopEvent
+{
+    int fd;
+    bool readable;
+    bool writable;
+    bool hangup;
+};
+
+/**
+ * Readiness multiplexer over a set of file descriptors. Uses epoll on Linux, kqueue on the BSDs and
+ * macOS, and falls back to select everywhere else (or when CLI_EVENT_LOOP_SELECT is defined).
+ *
+ * An instance is owned by a single thread. Errors are reported the same way as the socket API: a
+ * false or -1 return with errno set.
+ */
+class EventLoop
+{
+protected:
+#if defined(CLI_EVENT_LOOP_BACKEND_SELECT)
+    struct Interest
+    {
+        int fd;
+        bool readable;
+        bool writable;
+    };
+    std::vector<Interest> fds;
+#else
+    int handle{-1};
+#endif
+
+public:
+    EventLoop();
+    EventLoop(const EventLoop &) = delete;
+    EventLoop &operator=(const EventLoop &) = delete;
+    virtual ~EventLoop();
+
+    /**
+     * Get the name of the backend compiled in.
+     *
+     * @return "epoll", "kqueue" or "select".
+     */
+    [[nodiscard]] static const char *Backend();
+
+    /**
+     * Check if the backend was created successfully.
+     *
+     * @return True if the event loop can be used.
+     */
+    [[nodiscard]] bool IsOpen() const;
+
+    /**
+     * Start watching a file descriptor for readability.
+     *
+     * @param fd        File descriptor to watch.
+     * @param exclusive Only wake one of the event loops sharing this descriptor (listening sockets).
+     * @return          True on success.
+     */
+    bool Add(int fd, bool exclusive = false);
+
+    /**
+     * Change what a watched file descriptor is waited for. Not valid for exclusive descriptors.
+     *
+     * @param fd       File descriptor already added.
+     * @param readable Wake up when it can be read.
+     * @param writable Wake up when it can be written.
+     * @param hangup   Wake up when the other end closes its side, even while not reading. Turn it off
+     *                 once the hang up has been seen, or it keeps waking up.
+     * @return         True on success.
+     */
+    bool Modify(int fd, bool readable, bool writable, bool hangup = true);
+
+    /**
+     * Stop watching a file descriptor. Must be called before the descriptor is closed.
+     *
+     * @param fd File descriptor to forget.
+     * @return   True on success.
+     */
+    bool Remove(int fd);
+
+    /**
+     * Wait for any of the watched descriptors to become ready.
+     *
+     * @param events     Filled with the ready descriptors.
+     * @param timeout_ms Maximum time to wait in milliseconds, or -1 to wait forever.
+     * @return           Number of events, 0 on timeout or -1 on error.
+     */
+    int Wait(std::vector<EventLoopEvent> &events, int timeout_ms);
+};
+
+/**
+ * A descriptor that other threads can make readable to wake up an event loop, or a select, that is
+ * waiting on it. Uses an eventfd on Linux and a self pipe everywhere else.
+ *
+ * Once signalled it stays readable until Clear is called, so a single Signal wakes every waiter.
+ */
+class EventLoopWakeup
+{
+protected:
+    int read_fd{-1};
+    int write_fd{-1};
+
+public:
+    EventLoopWakeup();
+    EventLoopWakeup(const EventLoopWakeup &) = delete;
+    EventLoopWakeup &operator=(const EventLoopWakeup &) = delete;
+    virtual ~EventLoopWakeup();
+
+    /**
+     * Check if the descriptors were created successfully.
+     *
+     * @return True if the wakeup can be used.
+     */
+    [[nodiscard]] bool IsOpen() const { return read_fd != -1; };
+
+    /**
+     * Get the descriptor to watch for readability.
+     *
+     * @return The read end of the wakeup.
+     */
+    [[nodiscard]] int Fd() const { return read_fd; };
+
+    /**
+     * Make the descriptor readable. Safe to call from any thread, or from a signal handler.
+     *
+     * @return True on success.
+     */
+    bool Signal() const;
+
+    /**
+     * Consume any pending signals so the descriptor is no longer readable.
+     */
+    void Clear() const;
+};
+
+/*---------------------------------------------------------------------
+  -- function prototypes
+  ---------------------------------------------------------------------*/
+
+/*---------------------------------------------------------------------
+  -- global variables
+  ---------------------------------------------------------------------*/
+
+/*---------------------------------------------------------------------
+  -- local variables
+  ---------------------------------------------------------------------*/
+
+/*---------------------------------------------------------------------
+  -- private functions
+  ---------------------------------------------------------------------*/
+
+/*---------------------------------------------------------------------
+  -- public functions
+  ---------------------------------------------------------------------*/
@@ -0,0 +1,376 @@
+/* ********************************************************************
+   * Project   : Load generator
+   * Author    : Simon Martin
+   * Copyright : LGPL v3
+   ********************************************************************
+
+    Modifications:
+    0.01 14/10/2026 Initial version.
+*/
+
+/*---------------------------------------------------------------------
+  -- compatibility
+  ---------------------------------------------------------------------*/
+
+/*---------------------------------------------------------------------
+  -- project includes (import)
+  ---------------------------------------------------------------------*/
+#include "CommandLine.h"
+#include "EventLoop.h"
+
+/*---------------------------------------------------------------------
+  -- project includes (export)
+  ---------------------------------------------------------------------*/
+
+/*---------------------------------------------------------------------
+  -- C standard includes
+  ---------------------------------------------------------------------*/
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <netdb.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+/*---------------------------------------------------------------------
+  -- C++ standard includes
+  ---------------------------------------------------------------------*/
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <deque>
+#include <format>
+#include <iostream>
+#include <limits>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+/*---------------------------------------------------------------------
+  -- macros
+  ---------------------------------------------------------------------*/
+#define DEFAULT_HOST "127.0.0.1"
+#define DEFAULT_PORT "8023"
+#define DEFAULT_SESSIONS 16
+#define DEFAULT_PIPELINE 1
+#define DEFAULT_DURATION 10
+#define DEFAULT_COMMAND "DIR"
+#define DRAIN_TIMEOUT 5 // Seconds after the run to wait for the last answers
+
+#ifdef MSG_NOSIGNAL
+#define SEND_FLAGS MSG_NOSIGNAL
+#else
+#define SEND_FLAGS 0
+#endif
+
+/*---------------------------------------------------------------------
+  -- forward declarations
+  ---------------------------------------------------------------------*/
+
+/*---------------------------------------------------------------------
+  -- data types
+  ---------------------------------------------------------------------*/
+/**
+ * One connection to the server.
+ */
+struct LoadSession {
+  int socket;
+  std::string output; // Commands waiting to be sent
+  std::deque<std::chrono::steady_clock::time_point> in_flight; // When each unanswered command was queued
+  bool ready; // The server has sent its first prompt
+  bool blocked; // Waiting for the server to take what we send
+  bool partial_prompt; // The last thing received was the first character of a prompt
+};
+
+/**
+ * Settings shared by all the threads.
+ */
+struct LoadSettings {
+  std::string command;
+  int pipeline{DEFAULT_PIPELINE};
+  std::chrono::steady_clock::time_point deadline;
+};
+
+/**
+ * What one thread measured.
+ */
+struct LoadResult {
+  std::vector<uint32_t> latencies; // Microseconds
+  size_t errors{0};
+};
+
+/*---------------------------------------------------------------------
+  -- function prototypes
+  ---------------------------------------------------------------------*/
+
+/*---------------------------------------------------------------------
+  -- global variables
+  ---------------------------------------------------------------------*/
+
+/*---------------------------------------------------------------------
+  -- local variables
+  ---------------------------------------------------------------------*/
+static LoadSettings settings;
+
+// The command line, fixed at compile time
+static constexpr std::array<CommandLineOptionSpec, 7> load_options{{
+    {"host", 'h', false, HasValue::Required, Occurs::AtMost, 1, "Server host name or address. If not specified, then 127.0.0.1."},
+    {"port", 'p', false, HasValue::Required, Occurs::AtMost, 1, "Server TCP port. If not specified, then 8023."},
+    {"sessions", 'c', false, HasValue::Required, Occurs::AtMost, 1, "Number of connections open at the same time. If not specified, then 16.", CommandLineValueType::Integer(1, std::numeric_limits<int>::max())},
+    {"threads", 'T', false, HasValue::Required, Occurs::AtMost, 1, "Number of threads driving the connections. If not specified, then 1.", CommandLineValueType::Integer(1, std::numeric_limits<int>::max())},
+    {"pipeline", 'P', false, HasValue::Required, Occurs::AtMost, 1, "Commands sent on each connection without waiting for the answers. If not specified, then 1.", CommandLineValueType::Integer(1, std::numeric_limits<int>::max())},
+    {"duration", 'd', false, HasValue::Required, Occurs::AtMost, 1, "Seconds to run for. If not specified, then 10.", CommandLineValueType::Integer(1, std::numeric_limits<int>::max())},
+    {"command", 'C', false, HasValue::Required, Occurs::AtMost, 1, "Command line to send. If not specified, then DIR."},
+}};
+using LoadCommandLine = StaticCommandLine<load_options>;
+
+/*---------------------------------------------------------------------
+  -- private functions
+  ---------------------------------------------------------------------*/
+static int session_connect(const addrinfo *address) {
+  int s = socket(address->ai_family, address->ai_socktype, address->ai_protocol);
+  if (s == -1) {
+    return -1;
+  }
+
+  // Connect while blocking, then switch to non blocking for the run
+  int one = 1;
+  if (connect(s, address->ai_addr, address->ai_addrlen) == -1 || setsockopt(s, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one)) == -1 || fcntl(s, F_SETFL, fcntl(s, F_GETFL) | O_NONBLOCK) == -1) {
+    int error = errno;
+    close(s);
+    errno = error;
+    return -1;
+  }
+  return s;
+}
+
+static bool session_fill(LoadSession &session) {
+  // Keep the pipeline full until the run is over
+  auto now = std::chrono::steady_clock::now();
+  while (session.ready && now < settings.deadline && static_cast<int>(session.in_flight.size()) < settings.pipeline) {
+    session.output += settings.command;
+    session.in_flight.push_back(now);
+  }
+
+  // Send as much as the socket will take
+  while (!session.output.empty()) {
+    ssize_t bytes_sent = send(session.socket, session.output.data(), session.output.size(), SEND_FLAGS);
+    if (bytes_sent == -1) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return errno == EAGAIN || errno == EWOULDBLOCK;
+    }
+    session.output.erase(0, bytes_sent);
+  }
+  return true;
+}
+
+static void session_receive(LoadSession &session, const char *data, ssize_t size, LoadResult &result) {
+  // Every command is answered with a prompt, so each prompt completes the oldest command
+  auto now = std::chrono::steady_clock::now();
+  for (ssize_t i = 0; i < size; i++) {
+    if (data[i] != '>') {
+      session.partial_prompt = false;
+      continue;
+    }
+    if (!session.partial_prompt) {
+      session.partial_prompt = true;
+      continue;
+    }
+    session.partial_prompt = false;
+
+    // The first prompt comes with the connection
+    if (!session.ready) {
+      session.ready = true;
+      continue;
+    }
+    if (!session.in_flight.empty()) {
+      auto latency = std::chrono::duration_cast<std::chrono::microseconds>(now - session.in_flight.front()).count();
+      result.latencies.push_back(static_cast<uint32_t>(std::min<long long>(latency, UINT32_MAX)));
+      session.in_flight.pop_front();
+    }
+  }
+}
+
+static void load(const addrinfo *address, int session_count, LoadResult &result) {
+  EventLoop loop;
+  if (!loop.IsOpen()) {
+    std::cerr << "Error: failed to create event loop: " << strerror(errno) << std::endl;
+    result.errors += session_count;
+    return;
+  }
+
+  // Open all the sessions before starting
+  std::unordered_map<int, LoadSession> sessions;
+  for (int i = 0; i < session_count; i++) {
+    int s = session_connect(address);
+    if (s == -1 || !loop.Add(s)) {
+      std::cerr << "Error: failed to connect: " << strerror(errno) << std::endl;
+      if (s != -1) {
+        close(s);
+      }
+      result.errors++;
+      continue;
+    }
+    sessions.emplace(s, LoadSession{.socket = s, .output = {}, .in_flight = {}, .ready = false, .blocked = false, .partial_prompt = false});
+  }
+
+  // Run until the deadline, and then until everything sent has been answered
+  std::vector<EventLoopEvent> events;
+  std::vector<char> buffer(65536);
+  auto close_session = [&loop, &sessions, &result](int s) {
+    result.errors++;
+    loop.Remove(s);
+    close(s);
+    sessions.erase(s);
+  };
+  while (!sessions.empty()) {
+    auto now = std::chrono::steady_clock::now();
+    if (now > settings.deadline + std::chrono::seconds(DRAIN_TIMEOUT)) {
+      result.errors += sessions.size();
+      break;
+    }
+    std::erase_if(sessions, [&loop, now](const auto &entry) {
+      if (now < settings.deadline || !entry.second.in_flight.empty()) {
+        return false;
+      }
+      loop.Remove(entry.first);
+      close(entry.first);
+      return true;
+    });
+
+    int timeout = static_cast<int>(std::max<long long>(std::chrono::duration_cast<std::chrono::milliseconds>(settings.deadline - now).count(), 0)) + 1;
+    if (loop.Wait(events, timeout) == -1) {
+      if (errno == EINTR) {
+        continue;
+      }
+      std::cerr << "Error: failed to wait on event loop: " << strerror(errno) << std::endl;
+      break;
+    }
+
+    for (const auto &event : events) {
+      auto session = sessions.find(event.fd);
+      if (session == sessions.end()) {
+        continue;
+      }
+
+      if (event.readable) {
+        ssize_t bytes_received = recv(event.fd, buffer.data(), buffer.size(), 0);
+        if (bytes_received <= 0) {
+          if (bytes_received == -1 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) {
+            continue;
+          }
+          close_session(event.fd);
+          continue;
+        }
+        session_receive(session->second, buffer.data(), bytes_received, result);
+      }
+      else if (event.hangup) {
+        close_session(event.fd);
+        continue;
+      }
+
+      // Send the next commands, and only wait for write space while the server is not taking them
+      if (!session_fill(session->second)) {
+        close_session(event.fd);
+        continue;
+      }
+      if (bool blocked = !session->second.output.empty(); blocked != session->second.blocked) {
+        session->second.blocked = blocked;
+        loop.Modify(event.fd, true, blocked);
+      }
+    }
+  }
+
+  // Whatever is left did not finish in time
+  for (const auto &session : sessions) {
+    loop.Remove(session.first);
+    close(session.first);
+  }
+}
+
+static uint32_t percentile(const std::vector<uint32_t> &sorted, double fraction) {
+  size_t index = static_cast<size_t>(fraction * static_cast<double>(sorted.size()));
+  return sorted[std::min(index, sorted.size() - 1)];
+}
+
+/*---------------------------------------------------------------------
+  -- public functions
+  ---------------------------------------------------------------------*/
+
+int main(int argc, char *argv[]) {
+  // Get the parameters
+  LoadCommandLine cmd_run;
+  if (std::stringstream error_message; !cmd_run.Parse(argc, argv, error_message)) {
+    std::cerr << error_message.str() << std::endl;
+    cmd_run.PrintUsage(argv);
+    return 1;
+  }
+  int session_count = DEFAULT_SESSIONS;
+  cmd_run.GetOptionValue<LoadCommandLine::IndexOf("sessions")>(session_count);
+  int thread_count = 1;
+  cmd_run.GetOptionValue<LoadCommandLine::IndexOf("threads")>(thread_count);
+  cmd_run.GetOptionValue<LoadCommandLine::IndexOf("pipeline")>(settings.pipeline);
+  int duration = DEFAULT_DURATION;
+  cmd_run.GetOptionValue<LoadCommandLine::IndexOf("duration")>(duration);
+  thread_count = std::min(thread_count, session_count);
+  std::string_view command = DEFAULT_COMMAND;
+  cmd_run.GetOptionValue<LoadCommandLine::IndexOf("command")>(command);
+  settings.command = std::string{command} + "\r\n";
+
+  // Find the server
+  std::string_view host = DEFAULT_HOST;
+  cmd_run.GetOptionValue<LoadCommandLine::IndexOf("host")>(host);
+  std::string_view port = DEFAULT_PORT;
+  cmd_run.GetOptionValue<LoadCommandLine::IndexOf("port")>(port);
+  addrinfo hints{};
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  addrinfo *address = nullptr;
+  // Both are literals or the ends of arguments, so they are terminated
+  if (int error = getaddrinfo(host.data(), port.data(), &hints, &address); error) {
+    std::cerr << "Error: failed to resolve " << host << ": " << gai_strerror(error) << std::endl;
+    return 1;
+  }
+
+  // Share the sessions out between the threads
+  settings.deadline = std::chrono::steady_clock::now() + std::chrono::seconds(duration);
+  std::vector<LoadResult> results(thread_count);
+  std::vector<std::thread> threads;
+  auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < thread_count; i++) {
+    int share = session_count / thread_count + (i < session_count % thread_count ? 1 : 0);
+    threads.emplace_back(load, address, share, std::ref(results[i]));
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+  double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  freeaddrinfo(address);
+
+  // Put all the measurements together
+  std::vector<uint32_t> latencies;
+  size_t errors = 0;
+  for (auto &result : results) {
+    latencies.insert(latencies.end(), result.latencies.begin(), result.latencies.end());
+    errors += result.errors;
+  }
+  std::ranges::sort(latencies);
+
+  size_t requests = latencies.size();
+  double throughput = static_cast<double>(requests) / elapsed;
+  std::cout << std::format("sessions {0} pipeline {1} threads {2}", session_count, settings.pipeline, thread_count) << std::endl;
+  std::cout << std::format("requests {0} in {1:.2f}s, {2:.0f} req/s, {3} error(s)", requests, elapsed, throughput, errors) << std::endl;
+  if (!latencies.empty()) {
+    uint32_t p50 = percentile(latencies, 0.5);
+    uint32_t p99 = percentile(latencies, 0.99);
+    uint32_t p999 = percentile(latencies, 0.999);
+    uint32_t max = latencies.back();
+    std::cout << std::format("latency p50 {0}us p99 {1}us p999 {2}us max {3}us", p50, p99, p999, max) << std::endl;
+  }
+  return errors ? 1 : 0;
+}
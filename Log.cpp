@@ -0,0 +1,815 @@
+/* ********************************************************************
+   * Project   : Logging
+   * Author    : Simon Martin
+   * Copyright : LGPL v3
+   ********************************************************************
+
+    Modifications:
+    0.01 14/10/2026 Initial version, moved out of main.cpp.
+*/
+
+/*---------------------------------------------------------------------
+  -- compatibility
+  ---------------------------------------------------------------------*/
+
+/*---------------------------------------------------------------------
+  -- project includes (import)
+  ---------------------------------------------------------------------*/
+
+/*---------------------------------------------------------------------
+  -- project includes (export)
+  ---------------------------------------------------------------------*/
+#include "Log.h"
+
+/*---------------------------------------------------------------------
+  -- C standard includes
+  ---------------------------------------------------------------------*/
+#include <fcntl.h>
+#include <sys/stat.h>
+#ifdef _MSC_VER
+#include <io.h>
+#else
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+/*---------------------------------------------------------------------
+  -- C++ standard includes
+  ---------------------------------------------------------------------*/
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/*---------------------------------------------------------------------
+  -- macros
+  ---------------------------------------------------------------------*/
+#define MIN_LOG_RING 4096
+#define LOG_MAP_CHUNK (1 << 20) // A mapped log file grows by at least this much at a time
+
+/*---------------------------------------------------------------------
+  -- forward declarations
+  ---------------------------------------------------------------------*/
+
+/*---------------------------------------------------------------------
+  -- data types
+  ---------------------------------------------------------------------*/
+/**
+ * Single producer, single consumer queue of length prefixed records. The owning thread pushes and the
+ * writer thread drains, neither ever takes a lock.
+ */
+class LogRing
+{
+protected:
+    std::vector<char> data;
+    size_t mask;
+    std::atomic<size_t> head{0}; // Only written by the producer
+    std::atomic<size_t> tail{0}; // Only written by the consumer
+
+    void CopyIn(size_t position, const void *source, size_t size)
+    {
+        size_t offset = position & mask;
+        size_t first = std::min(size, data.size() - offset);
+        memcpy(data.data() + offset, source, first);
+        memcpy(data.data(), static_cast<const char *>(source) + first, size - first);
+    }
+
+    void CopyOut(size_t position, void *destination, size_t size) const
+    {
+        size_t offset = position & mask;
+        size_t first = std::min(size, data.size() - offset);
+        memcpy(destination, data.data() + offset, first);
+        memcpy(static_cast<char *>(destination) + first, data.data(), size - first);
+    }
+
+public:
+    /**
+     * Set by the owning thread when it exits, so the writer can free the ring once it is empty.
+     */
+    std::atomic<bool> orphaned{false};
+
+    explicit LogRing(size_t size) : data(size), mask(size - 1) {}
+
+    /**
+     * Largest record that fits.
+     */
+    [[nodiscard]] size_t MaxRecord() const { return data.size() - sizeof(uint32_t); }
+
+    bool TryPush(std::string_view record)
+    {
+        size_t h = head.load(std::memory_order_relaxed);
+        size_t t = tail.load(std::memory_order_acquire);
+        if (sizeof(uint32_t) + record.size() > data.size() - (h - t))
+        {
+            return false;
+        }
+
+        auto length = static_cast<uint32_t>(record.size());
+        CopyIn(h, &length, sizeof(length));
+        CopyIn(h + sizeof(length), record.data(), record.size());
+        head.store(h + sizeof(length) + record.size(), std::memory_order_release);
+        return true;
+    }
+
+    void Drain(std::string &batch)
+    {
+        size_t t = tail.load(std::memory_order_relaxed);
+        size_t h = head.load(std::memory_order_acquire);
+        while (t != h)
+        {
+            uint32_t length;
+            CopyOut(t, &length, sizeof(length));
+            size_t start = batch.size();
+            batch.resize(start + length);
+            CopyOut(t + sizeof(length), batch.data() + start, length);
+            t += sizeof(length) + length;
+        }
+        tail.store(t, std::memory_order_release);
+    }
+};
+
+/**
+ * Things that each thread works out once, rather than for every record.
+ */
+struct LogThreadCache
+{
+    long pid;
+    long tid;
+    std::chrono::utc_seconds second{std::chrono::utc_seconds::min()}; // The second that prefix is for
+    LogFormat format{LogFormat::Text};                                 // The format that prefix is for
+    std::string prefix;                                                // Date and time up to the second
+    std::string message;                                               // Scratch space for escaping
+};
+
+/**
+ * Ties a ring to the lifetime of its thread.
+ */
+struct LogRingOwner
+{
+    std::shared_ptr<LogRing> ring;
+
+    ~LogRingOwner()
+    {
+        if (ring)
+        {
+            ring->orphaned = true;
+        }
+    }
+};
+
+/*---------------------------------------------------------------------
+  -- function prototypes
+  ---------------------------------------------------------------------*/
+
+/*---------------------------------------------------------------------
+  -- global variables
+  ---------------------------------------------------------------------*/
+std::atomic<LogLevel> log_level{LogLevel::Info};
+
+/*---------------------------------------------------------------------
+  -- local variables
+  ---------------------------------------------------------------------*/
+static std::mutex log_mutex;
+
+// Indexed by level
+static constexpr std::array<std::string_view, 5> level_names{"trace", "debug", "info", "warn", "error"};
+static constexpr std::array<std::string_view, 5> level_tags{"TRACE", "DEBUG", "INFO ", "WARN ", "ERROR"};
+
+static_assert(sizeof(LogBinaryRecord) == 32, "binary log records must not be padded");
+
+static std::atomic<bool> async_active{false};
+static size_t async_ring_size{DEFAULT_LOG_RING};
+static LogOverflow async_overflow{LogOverflow::Block};
+static std::atomic<bool> async_pending{false};
+static std::atomic<bool> async_stopping{false};
+static std::atomic<size_t> async_dropped{0};
+static std::thread async_writer;
+
+static std::mutex rings_mutex; // Only taken when a thread logs for the first time, and by the writer
+static std::vector<std::shared_ptr<LogRing>> rings;
+static thread_local LogRingOwner thread_ring;
+static thread_local LogThreadCache thread_cache{
+#ifdef _MSC_VER
+    .pid = 0,
+    .tid = 0,
+#else
+    .pid = getpid(),
+    .tid = syscall(SYS_gettid),
+#endif
+    .second = std::chrono::utc_seconds::min(),
+    .format = LogFormat::Text,
+    .prefix = {},
+    .message = {},
+};
+
+// Where the records go, only touched under log_mutex. The exception is the format, which every thread
+// that formats a record reads without it, so it is atomic
+static std::atomic<LogFormat> output_format{LogFormat::Text};
+static int output_fd{1};
+static bool output_memory_mapped{false};
+static char *output_map{nullptr};
+static size_t output_mapped{0}; // Bytes of the file that are mapped
+static size_t output_used{0};   // Bytes of the mapping that hold records
+
+/*---------------------------------------------------------------------
+  -- private functions
+  ---------------------------------------------------------------------*/
+static void append_time(std::string &record, std::chrono::utc_clock::time_point epoch, LogFormat format)
+{
+    // The date and time only need formatting when the second changes, chrono does the leap seconds
+    auto second = std::chrono::floor<std::chrono::seconds>(epoch);
+    if (second != thread_cache.second || format != thread_cache.format)
+    {
+        thread_cache.second = second;
+        thread_cache.format = format;
+        thread_cache.prefix.clear();
+        if (format == LogFormat::Json)
+        {
+            std::format_to(std::back_inserter(thread_cache.prefix), "{0:%F}T{0:%T}", second);
+        }
+        else
+        {
+            std::format_to(std::back_inserter(thread_cache.prefix), "{0:%F} {0:%T}", second);
+        }
+    }
+    record += thread_cache.prefix;
+
+    // Then the fraction of a second, as many digits as %T would have given
+    constexpr unsigned width = std::chrono::hh_mm_ss<std::chrono::utc_clock::duration>::fractional_width;
+    if constexpr (width > 0)
+    {
+        std::array<char, width + 1> fraction;
+        fraction[0] = '.';
+        auto ticks = static_cast<uint64_t>((epoch - second).count());
+        for (unsigned i = width; i > 0; i--)
+        {
+            fraction[i] = static_cast<char>('0' + ticks % 10);
+            ticks /= 10;
+        }
+        record.append(fraction.data(), fraction.size());
+    }
+}
+
+static size_t utf8_sequence(std::string_view value, size_t position)
+{
+    // The length of the UTF-8 character that starts here, or 0 if it is not one. Overlong forms, surrogates
+    // and anything past U+10FFFF are not characters either
+    auto byte = [&value](size_t i) { return i < value.size() ? static_cast<unsigned char>(value[i]) : 0U; };
+    auto continues = [&byte](size_t i, unsigned low = 0x80, unsigned high = 0xbf) { return byte(i) >= low && byte(i) <= high; };
+    unsigned lead = byte(position);
+    if (lead >= 0xc2 && lead <= 0xdf)
+    {
+        return continues(position + 1) ? 2 : 0;
+    }
+    if (lead >= 0xe0 && lead <= 0xef)
+    {
+        unsigned low = lead == 0xe0 ? 0xa0 : 0x80;
+        unsigned high = lead == 0xed ? 0x9f : 0xbf;
+        return continues(position + 1, low, high) && continues(position + 2) ? 3 : 0;
+    }
+    if (lead >= 0xf0 && lead <= 0xf4)
+    {
+        unsigned low = lead == 0xf0 ? 0x90 : 0x80;
+        unsigned high = lead == 0xf4 ? 0x8f : 0xbf;
+        return continues(position + 1, low, high) && continues(position + 2) && continues(position + 3) ? 4 : 0;
+    }
+    return 0;
+}
+
+static void append_json_string(std::string &record, std::string_view value)
+{
+    static constexpr char hex[] = "0123456789abcdef";
+
+    record += '"';
+    for (size_t start = 0; start < value.size();)
+    {
+        // Copy everything that needs no escaping in one go
+        size_t end = start;
+        while (end < value.size() && static_cast<unsigned char>(value[end]) >= ' ' && static_cast<unsigned char>(value[end]) < 0x80 && value[end] != '"' && value[end] != '\\')
+        {
+            end++;
+        }
+        record.append(value.substr(start, end - start));
+        if (end == value.size())
+        {
+            break;
+        }
+
+        // A character of more than one byte goes through as it is, if it is valid UTF-8. A byte that is not
+        // part of one is escaped as the code point of the same value, so the line stays valid JSON
+        if (static_cast<unsigned char>(value[end]) >= 0x80)
+        {
+            if (size_t length = utf8_sequence(value, end))
+            {
+                record.append(value.substr(end, length));
+                start = end + length;
+                continue;
+            }
+        }
+
+        // Then the character that does
+        switch (char chr = value[end])
+        {
+            case '"':
+                record += "\\\"";
+                break;
+            case '\\':
+                record += "\\\\";
+                break;
+            case '\n':
+                record += "\\n";
+                break;
+            case '\r':
+                record += "\\r";
+                break;
+            case '\t':
+                record += "\\t";
+                break;
+            default:
+                record += "\\u00";
+                record += hex[(static_cast<unsigned char>(chr) >> 4) & 0xf];
+                record += hex[static_cast<unsigned char>(chr) & 0xf];
+                break;
+        }
+        start = end + 1;
+    }
+    record += '"';
+}
+
+static void format_record(
+    std::string &record,
+    std::source_location location,
+    LogLevel level,
+    const bool lf_before,
+    const bool lf_after,
+    std::string_view format,
+    std::format_args &&args
+)
+{
+    // We only want the file name, not the path
+    const char *file = location.file_name();
+    if (const char *p = strrchr(file, '/'))
+    {
+        file = p + 1;
+    }
+    uint32_t line = location.line();
+
+    // get the time stamp
+    std::chrono::time_point<std::chrono::utc_clock> epoch = std::chrono::utc_clock::now();
+
+    // get process identifiers
+    long pid = thread_cache.pid;
+    long tid = thread_cache.tid;
+
+    // This is required by C++20 to allow us to pass the format arguments to std::vformat
+    const std::format_args &my_args = std::move(args);
+
+    switch (output_format.load(std::memory_order_relaxed))
+    {
+        case LogFormat::Json:
+        {
+            // The message has to be escaped, so it is formatted somewhere else first
+            thread_cache.message.clear();
+            std::vformat_to(std::back_inserter(thread_cache.message), format, my_args);
+
+            std::string_view name = level_names[static_cast<size_t>(level)];
+            std::string_view file_name = file;
+            record += "{\"time\":\"";
+            append_time(record, epoch, LogFormat::Json);
+            std::format_to(std::back_inserter(record), "Z\",\"level\":\"{0}\",\"file\":", name);
+            append_json_string(record, file_name);
+            std::format_to(std::back_inserter(record), ",\"line\":{0},\"pid\":{1},\"tid\":{2},\"message\":", line, pid, tid);
+            append_json_string(record, thread_cache.message);
+            record += "}\n";
+            break;
+        }
+
+        case LogFormat::Binary:
+        {
+            // Leave room for the header, and fill it in once the size is known
+            size_t start = record.size();
+            std::string_view file_name = std::string_view{file}.substr(0, UINT16_MAX);
+            record.resize(start + sizeof(LogBinaryRecord));
+            record += file_name;
+            std::vformat_to(std::back_inserter(record), format, my_args);
+
+            LogBinaryRecord header{
+                .size = static_cast<uint32_t>(record.size() - start),
+                .level = static_cast<uint8_t>(level),
+                .reserved = 0,
+                .file_size = static_cast<uint16_t>(file_name.size()),
+                .line = line,
+                .pid = static_cast<uint32_t>(pid),
+                .tid = static_cast<uint64_t>(tid),
+                .time = std::chrono::duration_cast<std::chrono::nanoseconds>(epoch.time_since_epoch()).count(),
+            };
+            memcpy(record.data() + start, &header, sizeof(header));
+            break;
+        }
+
+        case LogFormat::Text:
+        {
+            // If we want a line feed before, then we print it
+            if (lf_before)
+            {
+                record += "\r\n";
+            }
+
+            // The UTC clock is always at +0000
+            append_time(record, epoch, LogFormat::Text);
+            std::string_view tag = level_tags[static_cast<size_t>(level)];
+            if (pid == tid)
+            {
+                std::format_to(std::back_inserter(record), "+0000 [{0}@{1:05}:{2:05}] {3} ", file, line, pid, tag);
+            }
+            else
+            {
+                std::format_to(std::back_inserter(record), "+0000 [{0}@{1:05}:{2:05}:{3:x}] {4} ", file, line, pid, tid, tag);
+            }
+            std::vformat_to(std::back_inserter(record), format, my_args);
+
+            // Clear to end of line, and return to the start of the line
+            record += "\x1b[K\r";
+
+            // If we want a line feed after, then we print it
+            if (lf_after)
+            {
+                record += "\n";
+            }
+            break;
+        }
+    }
+}
+
+#ifndef _MSC_VER
+static size_t output_find_end(int fd, size_t size)
+{
+    if (!size)
+    {
+        return 0;
+    }
+    void *map = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+    if (map == MAP_FAILED)
+    {
+        return size;
+    }
+    std::string_view data{static_cast<const char *>(map), size};
+    size_t end = size;
+
+    // A binary log is walked record by record, as a record can end in zeroes
+    static constexpr std::string_view magic{LOG_BINARY_MAGIC};
+    if (data.starts_with(magic))
+    {
+        end = 0;
+        while (end < size)
+        {
+            if (data.substr(end).starts_with(magic))
+            {
+                end += magic.size();
+                continue;
+            }
+            LogBinaryRecord header;
+            if (size - end < sizeof(header))
+            {
+                break;
+            }
+            memcpy(&header, data.data() + end, sizeof(header));
+            if (header.size < sizeof(header) + header.file_size || header.size > size - end)
+            {
+                break;
+            }
+            end += header.size;
+        }
+    }
+    // Text and JSON records end in a line feed, never a zero
+    else
+    {
+        while (end && !data[end - 1])
+        {
+            end--;
+        }
+    }
+
+    munmap(map, size);
+    return end;
+}
+
+static bool output_reserve(size_t size)
+{
+    if (output_map && output_used + size <= output_mapped)
+    {
+        return true;
+    }
+
+    // Grow the file and map it again, doubling so that remapping is rare
+    if (output_map)
+    {
+        munmap(output_map, output_mapped);
+        output_map = nullptr;
+    }
+    size_t mapped = std::max(output_mapped * 2, output_used + size);
+    mapped = (mapped + LOG_MAP_CHUNK - 1) / LOG_MAP_CHUNK * LOG_MAP_CHUNK;
+    output_mapped = 0;
+    if (ftruncate(output_fd, static_cast<off_t>(mapped)) == -1)
+    {
+        return false;
+    }
+    void *map = mmap(nullptr, mapped, PROT_READ | PROT_WRITE, MAP_SHARED, output_fd, 0);
+    if (map == MAP_FAILED)
+    {
+        return false;
+    }
+
+    output_map = static_cast<char *>(map);
+    output_mapped = mapped;
+    return true;
+}
+#endif
+
+static void output_write(const char *data, size_t size)
+{
+#ifndef _MSC_VER
+    if (output_memory_mapped)
+    {
+        // There is nowhere to report a failure, so the records are lost
+        if (output_reserve(size))
+        {
+            memcpy(output_map + output_used, data, size);
+            output_used += size;
+        }
+        return;
+    }
+#endif
+
+    while (size)
+    {
+        auto written = write(output_fd, data, size);
+        if (written == -1)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            return;
+        }
+        data += written;
+        size -= static_cast<size_t>(written);
+    }
+}
+
+static void output_close()
+{
+#ifndef _MSC_VER
+    // Give back the part of the file that was never written
+    if (output_map)
+    {
+        munmap(output_map, output_mapped);
+        if (ftruncate(output_fd, static_cast<off_t>(output_used)) == -1)
+        {
+            // Nothing to be done, the tail of the file is left as zeroes
+        }
+    }
+#endif
+    if (output_fd != 1)
+    {
+        close(output_fd);
+    }
+
+    output_format.store(LogFormat::Text, std::memory_order_relaxed);
+    output_fd = 1;
+    output_memory_mapped = false;
+    output_map = nullptr;
+    output_mapped = 0;
+    output_used = 0;
+}
+
+static LogRing &get_thread_ring()
+{
+    if (!thread_ring.ring)
+    {
+        thread_ring.ring = std::make_shared<LogRing>(async_ring_size);
+
+        std::lock_guard lock(rings_mutex);
+        rings.push_back(thread_ring.ring);
+    }
+
+    return *thread_ring.ring;
+}
+
+static void async_push(std::string_view record)
+{
+    LogRing &ring = get_thread_ring();
+
+    // A record that can never fit is cut short rather than lost, as long as it is text. A binary record cut
+    // short no longer matches its header, and a JSON one is no longer JSON, so those are dropped
+    if (record.size() > ring.MaxRecord())
+    {
+        if (output_format.load(std::memory_order_relaxed) != LogFormat::Text)
+        {
+            async_dropped++;
+            return;
+        }
+        record = record.substr(0, ring.MaxRecord());
+    }
+
+    while (!ring.TryPush(record))
+    {
+        if (async_overflow == LogOverflow::Drop)
+        {
+            async_dropped++;
+            return;
+        }
+
+        // Make sure that the writer is awake to make room
+        async_pending = true;
+        async_pending.notify_one();
+        std::this_thread::yield();
+    }
+
+    // Wake up the writer
+    if (!async_pending.exchange(true))
+    {
+        async_pending.notify_one();
+    }
+}
+
+static void async_drain(std::string &batch)
+{
+    std::lock_guard lock(rings_mutex);
+    std::erase_if(rings, [&batch](const std::shared_ptr<LogRing> &ring) {
+        // Check before draining, so that nothing pushed before the thread exited is missed
+        bool orphaned = ring->orphaned;
+        ring->Drain(batch);
+        return orphaned;
+    });
+}
+
+static void async_write()
+{
+    std::string batch;
+    while (true)
+    {
+        // Sleep until somebody logs, or we are told to stop
+        async_pending.wait(false);
+        async_pending = false;
+        bool stopping = async_stopping;
+
+        // Collect everything that is there and write it in one go
+        batch.clear();
+        async_drain(batch);
+        if (size_t dropped = async_dropped.exchange(0))
+        {
+            format_record(batch, std::source_location::current(), LogLevel::Warn, false, true, "{0} log record(s) dropped", std::make_format_args(dropped));
+        }
+        if (!batch.empty())
+        {
+            std::lock_guard lock(log_mutex);
+            output_write(batch.data(), batch.size());
+        }
+
+        if (stopping)
+        {
+            return;
+        }
+    }
+}
+
+/*---------------------------------------------------------------------
+  -- public functions
+  ---------------------------------------------------------------------*/
+
+void write_log(
+    std::source_location location,
+    LogLevel level,
+    // ReSharper disable once CppDFAConstantParameter
+    const bool lf_before,
+    // ReSharper disable once CppDFAConstantParameter
+    const bool lf_after,
+    std::string_view format,
+    std::format_args &&args
+)
+{
+    // Each thread formats into its own buffer, which keeps its capacity from one record to the next
+    static thread_local std::string record;
+    record.clear();
+    format_record(record, location, level, lf_before, lf_after, format, std::move(args));
+
+    // Hand it to the writer
+    if (async_active)
+    {
+        async_push(record);
+        return;
+    }
+
+    // Log the line
+    std::lock_guard lock(log_mutex);
+    output_write(record.data(), record.size());
+}
+
+void log_set_level(LogLevel level)
+{
+    log_level = level;
+}
+
+bool log_open(LogFormat format, std::string_view path, bool memory_mapped)
+{
+    int fd = 1;
+    size_t used = 0;
+    if (!path.empty())
+    {
+        std::string file_name{path};
+#ifdef _MSC_VER
+        if (memory_mapped)
+        {
+            return false;
+        }
+        fd = open(file_name.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+#else
+        fd = open(file_name.c_str(), memory_mapped ? O_RDWR | O_CREAT | O_CLOEXEC : O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+#endif
+        if (fd == -1)
+        {
+            return false;
+        }
+
+        // A mapped file is appended to by writing after what is already there. If it was not closed
+        // cleanly, then the zeroes that it grew by are cut off first, or the records after them are lost
+        struct stat status;
+        if (memory_mapped && fstat(fd, &status) == 0)
+        {
+#ifndef _MSC_VER
+            used = output_find_end(fd, static_cast<size_t>(status.st_size));
+            if (used != static_cast<size_t>(status.st_size) && ftruncate(fd, static_cast<off_t>(used)) == -1)
+            {
+                close(fd);
+                return false;
+            }
+#endif
+        }
+    }
+
+    std::lock_guard lock(log_mutex);
+    output_close();
+    output_format.store(format, std::memory_order_relaxed);
+    output_fd = fd;
+    output_memory_mapped = memory_mapped;
+    output_used = used;
+
+    // A binary stream says what it is, the decoder skips this wherever it finds it between records
+    if (format == LogFormat::Binary)
+    {
+        static constexpr std::string_view magic{LOG_BINARY_MAGIC};
+        output_write(magic.data(), magic.size());
+    }
+    return true;
+}
+
+bool log_start_async(size_t ring_size, LogOverflow overflow)
+{
+    if (async_active)
+    {
+        return true;
+    }
+
+    async_ring_size = std::bit_ceil(std::max<size_t>(ring_size, MIN_LOG_RING));
+    async_overflow = overflow;
+    async_stopping = false;
+    async_pending = false;
+    try
+    {
+        async_writer = std::thread(async_write);
+    }
+    catch (const std::system_error &)
+    {
+        return false;
+    }
+
+    async_active = true;
+    return true;
+}
+
+void log_stop()
+{
+    if (async_active)
+    {
+        // New records go straight out from now on, the writer picks up whatever is still queued
+        async_active = false;
+        async_stopping = true;
+        async_pending = true;
+        async_pending.notify_one();
+        async_writer.join();
+    }
+
+    std::lock_guard lock(log_mutex);
+    output_close();
+}
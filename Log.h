@@ -0,0 +1,229 @@
+/* ********************************************************************
+   * Project   : Logging
+   * Author    : Simon Martin
+   ********************************************************************
+
+    Modifications:
+    0.01 14/10/2026 Initial version, moved out of main.cpp.
+*/
+
+#pragma once
+
+/*---------------------------------------------------------------------
+  -- compatibility
+  ---------------------------------------------------------------------*/
+
+/*---------------------------------------------------------------------
+  -- project includes (import)
+  ---------------------------------------------------------------------*/
+
+/*---------------------------------------------------------------------
+  -- project includes (export)
+  ---------------------------------------------------------------------*/
+
+/*---------------------------------------------------------------------
+  -- C standard includes
+  ---------------------------------------------------------------------*/
+
+/*---------------------------------------------------------------------
+  -- C++ standard includes
+  ---------------------------------------------------------------------*/
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <format>
+#include <source_location>
+#include <string_view>
+
+/*---------------------------------------------------------------------
+  -- macros
+  ---------------------------------------------------------------------*/
+#define LOG_LEVEL_TRACE 0
+#define LOG_LEVEL_DEBUG 1
+#define LOG_LEVEL_INFO 2
+#define LOG_LEVEL_WARN 3
+#define LOG_LEVEL_ERROR 4
+
+// Levels below this are compiled out, e.g. -DLOG_MIN_LEVEL=LOG_LEVEL_INFO for production builds
+#ifndef LOG_MIN_LEVEL
+#define LOG_MIN_LEVEL LOG_LEVEL_TRACE
+#endif
+
+// The arguments are only formatted if the level is compiled in and above the threshold
+#define WRITE_LOG_AT(level, lf_before, lf_after, format, ...)                                                          \
+    do                                                                                                                 \
+    {                                                                                                                  \
+        if constexpr (static_cast<int>(level) >= LOG_MIN_LEVEL)                                                        \
+        {                                                                                                              \
+            if (log_enabled(level))                                                                                    \
+            {                                                                                                          \
+                write_log(std::source_location::current(), level, lf_before, lf_after, format,                         \
+                          std::make_format_args(__VA_ARGS__));                                                         \
+            }                                                                                                          \
+        }                                                                                                              \
+    } while (false)
+
+#define WRITE_LOG_TRACE(format, ...) WRITE_LOG_AT(LogLevel::Trace, false, true, format __VA_OPT__(, ) __VA_ARGS__)
+#define WRITE_LOG_DEBUG(format, ...) WRITE_LOG_AT(LogLevel::Debug, false, true, format __VA_OPT__(, ) __VA_ARGS__)
+#define WRITE_LOG_INFO(format, ...) WRITE_LOG_AT(LogLevel::Info, false, true, format __VA_OPT__(, ) __VA_ARGS__)
+#define WRITE_LOG_WARN(format, ...) WRITE_LOG_AT(LogLevel::Warn, false, true, format __VA_OPT__(, ) __VA_ARGS__)
+#define WRITE_LOG_ERROR(format, ...) WRITE_LOG_AT(LogLevel::Error, false, true, format __VA_OPT__(, ) __VA_ARGS__)
+
+#define WRITE_LOG(format, ...) WRITE_LOG_AT(LogLevel::Info, false, true, format __VA_OPT__(, ) __VA_ARGS__)
+#define WRITE_LOG_NO_LF(format, ...) WRITE_LOG_AT(LogLevel::Info, false, false, format __VA_OPT__(, ) __VA_ARGS__)
+#define WRITE_LOG_LF_BEFORE(format, ...) WRITE_LOG_AT(LogLevel::Info, true, true, format __VA_OPT__(, ) __VA_ARGS__)
+
+#define DEFAULT_LOG_RING 65536
+
+// Written at the start of binary output, ahead of the records
+#define LOG_BINARY_MAGIC "CLILOG1\n"
+
+/*---------------------------------------------------------------------
+  -- forward declarations
+  ---------------------------------------------------------------------*/
+
+/*---------------------------------------------------------------------
+  -- data types
+  ---------------------------------------------------------------------*/
+/**
+ * How important a record is. The values match the LOG_LEVEL_ macros.
+ */
+enum class LogLevel
+{
+    Trace = LOG_LEVEL_TRACE,
+    Debug = LOG_LEVEL_DEBUG,
+    Info = LOG_LEVEL_INFO,
+    Warn = LOG_LEVEL_WARN,
+    Error = LOG_LEVEL_ERROR,
+};
+
+/**
+ * How records are written out.
+ */
+enum class LogFormat
+{
+    /**
+     * Human readable lines for a terminal.
+     */
+    Text,
+    /**
+     * One JSON object per line.
+     */
+    Json,
+    /**
+     * LogBinaryRecord headers, each followed by the file name and the message.
+     */
+    Binary,
+};
+
+/**
+ * Header of a binary record, in the byte order of the machine that wrote it. It is followed by
+ * file_size bytes of file name and then the message, which runs to the end of the record.
+ */
+struct LogBinaryRecord
+{
+    uint32_t size;      // Whole record, including this header
+    uint8_t level;      // LogLevel
+    uint8_t reserved;   // Always 0
+    uint16_t file_size; // Length of the file name that follows the header
+    uint32_t line;
+    uint32_t pid;
+    uint64_t tid;
+    int64_t time;       // Nanoseconds since the UTC clock epoch, leap seconds included
+};
+
+/**
+ * What a thread does when its log ring is full.
+ */
+enum class LogOverflow
+{
+    /**
+     * Throw the record away and count it.
+     */
+    Drop,
+    /**
+     * Wait for the writer to make room.
+     */
+    Block,
+};
+
+/*---------------------------------------------------------------------
+  -- function prototypes
+  ---------------------------------------------------------------------*/
+/**
+ * Log a line. Use the WRITE_LOG macros rather than calling this directly.
+ *
+ * @param location  Where the log is written from.
+ * @param level     How important the record is.
+ * @param lf_before Start with a new line.
+ * @param lf_after  End with a new line.
+ * @param format    std::format format string.
+ * @param args      Arguments for the format string.
+ */
+void write_log(std::source_location location, LogLevel level, bool lf_before, bool lf_after, std::string_view format, std::format_args &&args);
+
+/**
+ * Set the least important level that is logged. Records below it are not formatted at all.
+ *
+ * @param level The new threshold.
+ */
+void log_set_level(LogLevel level);
+
+/**
+ * Choose how and where records are written. Until this is called they are written to standard output
+ * as text. Call before log_start_async.
+ *
+ * @param format        How records are written.
+ * @param path          File to append to, or empty for standard output.
+ * @param memory_mapped Write the file through a memory mapping that grows as needed, rather than with
+ *                      a system call per batch.
+ * @return              False if the file could not be opened, and then nothing changes.
+ */
+bool log_open(LogFormat format, std::string_view path, bool memory_mapped);
+
+/**
+ * Switch to asynchronous logging. Each thread formats its records into its own lock free ring, and
+ * a background thread writes them out in batches. Until this is called, and after log_stop, records
+ * are written straight away under a mutex.
+ *
+ * @param ring_size Size in bytes of each thread's ring, rounded up to a power of two.
+ * @param overflow  What to do when a ring is full.
+ * @return          True if the background thread was started.
+ */
+bool log_start_async(size_t ring_size, LogOverflow overflow);
+
+/**
+ * Write out everything still queued, stop the background thread, close the log file and go back to
+ * synchronous text logging on standard output. Call once the other threads have stopped logging.
+ */
+void log_stop();
+
+/*---------------------------------------------------------------------
+  -- global variables
+  ---------------------------------------------------------------------*/
+/**
+ * The runtime threshold, use log_set_level to change it.
+ */
+extern std::atomic<LogLevel> log_level;
+
+/*---------------------------------------------------------------------
+  -- local variables
+  ---------------------------------------------------------------------*/
+
+/*---------------------------------------------------------------------
+  -- private functions
+  ---------------------------------------------------------------------*/
+
+/*---------------------------------------------------------------------
+  -- public functions
+  ---------------------------------------------------------------------*/
+/**
+ * Check the runtime threshold. Inline so that a disabled record costs no more than a load.
+ *
+ * @param level How important the record is.
+ * @return      True if records of this level are logged.
+ */
+inline bool log_enabled(LogLevel level)
+{
+    return level >= log_level.load(std::memory_order_relaxed);
+}
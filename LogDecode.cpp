@@ -0,0 +1,178 @@
+/* ********************************************************************
+   * Project   : Log decoder
+   * Author    : Simon Martin
+   * Copyright : LGPL v3
+   ********************************************************************
+
+    Modifications:
+    0.01 14/10/2026 Initial version.
+*/
+
+/*---------------------------------------------------------------------
+  -- compatibility
+  ---------------------------------------------------------------------*/
+
+/*---------------------------------------------------------------------
+  -- project includes (import)
+  ---------------------------------------------------------------------*/
+#include "CommandLine.h"
+#include "Log.h"
+
+/*---------------------------------------------------------------------
+  -- project includes (export)
+  ---------------------------------------------------------------------*/
+
+/*---------------------------------------------------------------------
+  -- C standard includes
+  ---------------------------------------------------------------------*/
+
+/*---------------------------------------------------------------------
+  -- C++ standard includes
+  ---------------------------------------------------------------------*/
+#include <array>
+#include <chrono>
+#include <cstring>
+#include <format>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <sstream>
+#include <string>
+#include <string_view>
+
+/*---------------------------------------------------------------------
+  -- macros
+  ---------------------------------------------------------------------*/
+
+/*---------------------------------------------------------------------
+  -- forward declarations
+  ---------------------------------------------------------------------*/
+
+/*---------------------------------------------------------------------
+  -- data types
+  ---------------------------------------------------------------------*/
+
+/*---------------------------------------------------------------------
+  -- function prototypes
+  ---------------------------------------------------------------------*/
+
+/*---------------------------------------------------------------------
+  -- global variables
+  ---------------------------------------------------------------------*/
+
+/*---------------------------------------------------------------------
+  -- local variables
+  ---------------------------------------------------------------------*/
+static constexpr std::array<std::string_view, 5> level_tags{"TRACE", "DEBUG", "INFO ", "WARN ", "ERROR"};
+
+// The command line, fixed at compile time
+static constexpr std::array<CommandLineOptionSpec, 1> decode_options{{
+    {"input", 'i', false, HasValue::Required, Occurs::AtMost, 1, "Binary log file to decode. If not specified, then standard input."},
+}};
+using DecodeCommandLine = StaticCommandLine<decode_options>;
+
+/*---------------------------------------------------------------------
+  -- private functions
+  ---------------------------------------------------------------------*/
+static void decode_record(std::string &text, const LogBinaryRecord &header, std::string_view file, std::string_view message) {
+  // Same layout as the text log, without the terminal control sequences
+  std::chrono::utc_seconds second{std::chrono::floor<std::chrono::seconds>(std::chrono::nanoseconds{header.time})};
+  long long nanoseconds = header.time - std::chrono::duration_cast<std::chrono::nanoseconds>(second.time_since_epoch()).count();
+  std::string_view tag = header.level < level_tags.size() ? level_tags[header.level] : "?????";
+  uint32_t line = header.line;
+  uint32_t pid = header.pid;
+  uint64_t tid = header.tid;
+  std::format_to(std::back_inserter(text), "{0:%F} {0:%T}", second);
+  std::string fraction = std::to_string(nanoseconds + 1000000000LL);
+  fraction[0] = '.';
+  text += fraction;
+  if (pid == tid) {
+    std::format_to(std::back_inserter(text), "+0000 [{0}@{1:05}:{2:05}] {3} ", file, line, pid, tag);
+  }
+  else {
+    std::format_to(std::back_inserter(text), "+0000 [{0}@{1:05}:{2:05}:{3:x}] {4} ", file, line, pid, tid, tag);
+  }
+  text += message;
+  text += '\n';
+}
+
+/*---------------------------------------------------------------------
+  -- public functions
+  ---------------------------------------------------------------------*/
+
+int main(int argc, char *argv[]) {
+  int result = 1;
+
+  // Simplify error handling
+  do {
+    // Get the parameters
+    DecodeCommandLine cmd_run;
+    if (std::stringstream error_message; !cmd_run.Parse(argc, argv, error_message)) {
+      std::cerr << error_message.str() << std::endl;
+      cmd_run.PrintUsage(argv);
+      break;
+    }
+
+    // Read it all in, a log is decoded in one pass
+    std::string data;
+    if (cmd_run.IsOptionValue<DecodeCommandLine::IndexOf("input")>()) {
+      std::string path{cmd_run.GetOptionViews<DecodeCommandLine::IndexOf("input")>()[0]};
+      std::ifstream input(path, std::ios::binary);
+      if (!input) {
+        std::cerr << "Error: failed to open " << path << std::endl;
+        break;
+      }
+      data.assign(std::istreambuf_iterator<char>(input), std::istreambuf_iterator<char>());
+    }
+    else {
+      data.assign(std::istreambuf_iterator<char>(std::cin), std::istreambuf_iterator<char>());
+    }
+
+    // Walk the records
+    static constexpr std::string_view magic{LOG_BINARY_MAGIC};
+    std::string_view rest{data};
+    if (!rest.starts_with(magic)) {
+      std::cerr << "Error: not a binary log" << std::endl;
+      break;
+    }
+    std::string text;
+    result = 0;
+    while (!rest.empty()) {
+      // Logs that were appended to, or joined together, have the magic again between records
+      if (rest.starts_with(magic)) {
+        rest.remove_prefix(magic.size());
+        continue;
+      }
+
+      // The unused tail of a memory mapped log that was not closed is all zeroes
+      LogBinaryRecord header;
+      if (rest.size() < sizeof(header)) {
+        std::cerr << "Error: log ends part way through a record" << std::endl;
+        result = 1;
+        break;
+      }
+      memcpy(&header, rest.data(), sizeof(header));
+      if (header.size == 0) {
+        break;
+      }
+      if (header.size < sizeof(header) + header.file_size || header.size > rest.size()) {
+        std::cerr << "Error: corrupt record" << std::endl;
+        result = 1;
+        break;
+      }
+
+      std::string_view record = rest.substr(sizeof(header), header.size - sizeof(header));
+      decode_record(text, header, record.substr(0, header.file_size), record.substr(header.file_size));
+      rest.remove_prefix(header.size);
+
+      // Write it out in batches
+      if (text.size() >= 65536) {
+        std::cout.write(text.data(), static_cast<std::streamsize>(text.size()));
+        text.clear();
+      }
+    }
+    std::cout.write(text.data(), static_cast<std::streamsize>(text.size()));
+  } while (false);
+
+  return result;
+}
@@ -0,0 +1,318 @@
+/* ********************************************************************
+   * Project   : Server statistics
+   * Author    : Simon Martin
+   * Copyright : LGPL v3
+   ********************************************************************
+
+    Modifications:
+    0.01 14/10/2026 Initial version.
+*/
+
+/*---------------------------------------------------------------------
+  -- compatibility
+  ---------------------------------------------------------------------*/
+
+/*---------------------------------------------------------------------
+  -- project includes (import)
+  ---------------------------------------------------------------------*/
+
+/*---------------------------------------------------------------------
+  -- project includes (export)
+  ---------------------------------------------------------------------*/
+#include "Stats.h"
+
+/*---------------------------------------------------------------------
+  -- C standard includes
+  ---------------------------------------------------------------------*/
+
+/*---------------------------------------------------------------------
+  -- C++ standard includes
+  ---------------------------------------------------------------------*/
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <format>
+#include <iterator>
+#include <memory>
+#include <mutex>
+
+/*---------------------------------------------------------------------
+  -- macros
+  ---------------------------------------------------------------------*/
+// Each power of two is split into this many buckets, so a bucket is within about 6% of its values
+#define HISTOGRAM_SUB_BITS 4
+#define HISTOGRAM_SUB_BUCKETS (1 << HISTOGRAM_SUB_BITS)
+#define HISTOGRAM_BUCKETS ((64 - HISTOGRAM_SUB_BITS + 1) * HISTOGRAM_SUB_BUCKETS)
+
+/*---------------------------------------------------------------------
+  -- forward declarations
+  ---------------------------------------------------------------------*/
+
+/*---------------------------------------------------------------------
+  -- data types
+  ---------------------------------------------------------------------*/
+/**
+ * The statistics of one thread. Only the owning thread writes them, anybody can read them.
+ */
+struct StatsBlock
+{
+    std::array<std::atomic<uint64_t>, static_cast<size_t>(StatCounter::Count)> counters{};
+    std::vector<std::atomic<uint64_t>> buckets; // HISTOGRAM_BUCKETS for each histogram
+    std::vector<std::atomic<uint64_t>> sums;    // Total nanoseconds for each histogram
+
+    explicit StatsBlock(size_t histograms) : buckets(histograms * HISTOGRAM_BUCKETS), sums(histograms) {}
+};
+
+/**
+ * Statistics added up from a number of threads.
+ */
+struct StatsTotals
+{
+    std::array<uint64_t, static_cast<size_t>(StatCounter::Count)> counters{};
+    std::vector<uint64_t> buckets;
+    std::vector<uint64_t> sums;
+
+    void Add(const StatsBlock &block)
+    {
+        buckets.resize(block.buckets.size());
+        sums.resize(block.sums.size());
+        for (size_t i = 0; i < counters.size(); i++)
+        {
+            counters[i] += block.counters[i].load(std::memory_order_relaxed);
+        }
+        for (size_t i = 0; i < buckets.size(); i++)
+        {
+            buckets[i] += block.buckets[i].load(std::memory_order_relaxed);
+        }
+        for (size_t i = 0; i < sums.size(); i++)
+        {
+            sums[i] += block.sums[i].load(std::memory_order_relaxed);
+        }
+    }
+};
+
+/**
+ * Ties a block to the lifetime of its thread, and keeps what it counted once the thread has gone.
+ */
+struct StatsBlockOwner
+{
+    std::shared_ptr<StatsBlock> block;
+
+    ~StatsBlockOwner();
+};
+
+/*---------------------------------------------------------------------
+  -- function prototypes
+  ---------------------------------------------------------------------*/
+
+/*---------------------------------------------------------------------
+  -- global variables
+  ---------------------------------------------------------------------*/
+
+/*---------------------------------------------------------------------
+  -- local variables
+  ---------------------------------------------------------------------*/
+static constexpr std::array<std::string_view, static_cast<size_t>(StatCounter::Count)> counter_names{
+    "connections_accepted",
+    "connections_rejected",
+    "connections_closed",
+    "idle_timeouts",
+    "bytes_in",
+    "bytes_out",
+    "commands",
+    "unknown_commands",
+    "accept_errors",
+    "wait_errors",
+    "recv_errors",
+    "send_errors",
+};
+static constexpr std::array<std::string_view, static_cast<size_t>(StatHistogram::Count)> histogram_names{
+    "connection",
+    "accept",
+};
+
+static std::vector<std::string> command_names;
+
+static std::mutex blocks_mutex; // Only taken when a thread records for the first time or exits, and to report
+static std::vector<std::shared_ptr<StatsBlock>> blocks;
+static StatsTotals retired; // Threads that have exited
+static thread_local StatsBlockOwner thread_block;
+
+/*---------------------------------------------------------------------
+  -- private functions
+  ---------------------------------------------------------------------*/
+StatsBlockOwner::~StatsBlockOwner()
+{
+    if (block)
+    {
+        std::lock_guard lock(blocks_mutex);
+        retired.Add(*block);
+        std::erase(blocks, block);
+    }
+}
+
+static StatsBlock &get_thread_block()
+{
+    if (!thread_block.block)
+    {
+        thread_block.block = std::make_shared<StatsBlock>(static_cast<size_t>(StatHistogram::Count) + command_names.size());
+
+        std::lock_guard lock(blocks_mutex);
+        blocks.push_back(thread_block.block);
+    }
+
+    return *thread_block.block;
+}
+
+static void bump(std::atomic<uint64_t> &value, uint64_t amount)
+{
+    // There is only one writer, so there is no need for a locked read modify write
+    value.store(value.load(std::memory_order_relaxed) + amount, std::memory_order_relaxed);
+}
+
+static size_t bucket_index(uint64_t value)
+{
+    if (value < HISTOGRAM_SUB_BUCKETS)
+    {
+        return value;
+    }
+
+    // The power of two picks the row, and the next bits down pick the bucket in it
+    unsigned exponent = std::bit_width(value) - 1;
+    return (exponent - HISTOGRAM_SUB_BITS + 1) * HISTOGRAM_SUB_BUCKETS + ((value >> (exponent - HISTOGRAM_SUB_BITS)) & (HISTOGRAM_SUB_BUCKETS - 1));
+}
+
+static uint64_t bucket_highest(size_t index)
+{
+    if (index < HISTOGRAM_SUB_BUCKETS)
+    {
+        return index;
+    }
+
+    unsigned exponent = index / HISTOGRAM_SUB_BUCKETS + HISTOGRAM_SUB_BITS - 1;
+    uint64_t lowest = (HISTOGRAM_SUB_BUCKETS + index % HISTOGRAM_SUB_BUCKETS) << (exponent - HISTOGRAM_SUB_BITS);
+    return lowest + ((uint64_t{1} << (exponent - HISTOGRAM_SUB_BITS)) - 1);
+}
+
+static void record(size_t histogram, std::chrono::nanoseconds time)
+{
+    StatsBlock &block = get_thread_block();
+    auto value = static_cast<uint64_t>(std::max<std::chrono::nanoseconds::rep>(time.count(), 0));
+    bump(block.buckets[histogram * HISTOGRAM_BUCKETS + bucket_index(value)], 1);
+    bump(block.sums[histogram], value);
+}
+
+static std::string format_duration(uint64_t nanoseconds)
+{
+    if (nanoseconds < 10000)
+    {
+        return std::format("{0}ns", nanoseconds);
+    }
+    if (nanoseconds < 10000000)
+    {
+        uint64_t value = nanoseconds / 1000;
+        return std::format("{0}us", value);
+    }
+    if (nanoseconds < 10000000000)
+    {
+        uint64_t value = nanoseconds / 1000000;
+        return std::format("{0}ms", value);
+    }
+    uint64_t value = nanoseconds / 1000000000;
+    return std::format("{0}s", value);
+}
+
+static void report_histogram(std::string &out, std::string_view name, const uint64_t *buckets, uint64_t sum)
+{
+    uint64_t count = 0;
+    for (size_t i = 0; i < HISTOGRAM_BUCKETS; i++)
+    {
+        count += buckets[i];
+    }
+    if (!count)
+    {
+        std::format_to(std::back_inserter(out), "{0} count=0\n", name);
+        return;
+    }
+
+    // Each percentile is the highest value of the bucket that it falls in
+    auto percentile = [buckets, count](uint64_t per_thousand) {
+        uint64_t wanted = std::max<uint64_t>((count * per_thousand + 999) / 1000, 1);
+        uint64_t seen = 0;
+        for (size_t i = 0; i < HISTOGRAM_BUCKETS; i++)
+        {
+            if ((seen += buckets[i]) >= wanted)
+            {
+                return bucket_highest(i);
+            }
+        }
+        return bucket_highest(HISTOGRAM_BUCKETS - 1);
+    };
+
+    std::string mean = format_duration(sum / count);
+    std::string p50 = format_duration(percentile(500));
+    std::string p99 = format_duration(percentile(990));
+    std::string p999 = format_duration(percentile(999));
+    std::string max = format_duration(percentile(1000));
+    std::format_to(std::back_inserter(out), "{0} count={1} mean={2} p50={3} p99={4} p999={5} max={6}\n", name, count, mean, p50, p99, p999, max);
+}
+
+/*---------------------------------------------------------------------
+  -- public functions
+  ---------------------------------------------------------------------*/
+
+void stats_set_commands(const std::vector<std::string_view> &names)
+{
+    command_names.assign(names.begin(), names.end());
+}
+
+void stats_add(StatCounter counter, uint64_t value)
+{
+    bump(get_thread_block().counters[static_cast<size_t>(counter)], value);
+}
+
+void stats_record(StatHistogram histogram, std::chrono::nanoseconds time)
+{
+    record(static_cast<size_t>(histogram), time);
+}
+
+void stats_record_command(size_t index, std::chrono::nanoseconds time)
+{
+    if (index < command_names.size())
+    {
+        record(static_cast<size_t>(StatHistogram::Count) + index, time);
+    }
+}
+
+void stats_report(std::string &out)
+{
+    // Add up what every thread has seen so far
+    StatsTotals totals;
+    {
+        std::lock_guard lock(blocks_mutex);
+        totals = retired;
+        for (const auto &block : blocks)
+        {
+            totals.Add(*block);
+        }
+    }
+    totals.buckets.resize((static_cast<size_t>(StatHistogram::Count) + command_names.size()) * HISTOGRAM_BUCKETS);
+    totals.sums.resize(static_cast<size_t>(StatHistogram::Count) + command_names.size());
+
+    for (size_t i = 0; i < counter_names.size(); i++)
+    {
+        std::string_view name = counter_names[i];
+        uint64_t value = totals.counters[i];
+        std::format_to(std::back_inserter(out), "{0} {1}\n", name, value);
+    }
+    for (size_t i = 0; i < histogram_names.size(); i++)
+    {
+        report_histogram(out, histogram_names[i], &totals.buckets[i * HISTOGRAM_BUCKETS], totals.sums[i]);
+    }
+    for (size_t i = 0; i < command_names.size(); i++)
+    {
+        size_t histogram = static_cast<size_t>(StatHistogram::Count) + i;
+        report_histogram(out, "command " + command_names[i], &totals.buckets[histogram * HISTOGRAM_BUCKETS], totals.sums[histogram]);
+    }
+}
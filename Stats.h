@@ -0,0 +1,135 @@
+/* ********************************************************************
+   * Project   : Server statistics
+   * Author    : Simon Martin
+   ********************************************************************
+
+    Modifications:
+    0.01 14/10/2026 Initial version.
+*/
+
+#pragma once
+
+/*---------------------------------------------------------------------
+  -- compatibility
+  ---------------------------------------------------------------------*/
+
+/*---------------------------------------------------------------------
+  -- project includes (import)
+  ---------------------------------------------------------------------*/
+
+/*---------------------------------------------------------------------
+  -- project includes (export)
+  ---------------------------------------------------------------------*/
+
+/*---------------------------------------------------------------------
+  -- C standard includes
+  ---------------------------------------------------------------------*/
+
+/*---------------------------------------------------------------------
+  -- C++ standard includes
+  ---------------------------------------------------------------------*/
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/*---------------------------------------------------------------------
+  -- macros
+  ---------------------------------------------------------------------*/
+
+/*---------------------------------------------------------------------
+  -- forward declarations
+  ---------------------------------------------------------------------*/
+
+/*---------------------------------------------------------------------
+  -- data types
+  ---------------------------------------------------------------------*/
+/**
+ * Things that are counted.
+ */
+enum class StatCounter
+{
+    ConnectionsAccepted,
+    ConnectionsRejected,
+    ConnectionsClosed,
+    IdleTimeouts,
+    BytesIn,
+    BytesOut,
+    Commands,
+    UnknownCommands,
+    AcceptErrors,
+    WaitErrors, // select or event loop
+    RecvErrors,
+    SendErrors,
+    Count,
+};
+
+/**
+ * Things that are timed, on top of each command.
+ */
+enum class StatHistogram
+{
+    Connection, // From accept to close
+    Accept,     // One pass of an accept loop, draining the backlog
+    Count,
+};
+
+/*---------------------------------------------------------------------
+  -- function prototypes
+  ---------------------------------------------------------------------*/
+/**
+ * Name the commands that are timed one by one, in the order of their indexes. Call once, before any
+ * thread records anything.
+ *
+ * @param names The command names.
+ */
+void stats_set_commands(const std::vector<std::string_view> &names);
+
+/**
+ * Add to a counter. Each thread has its own counters, so this is a plain load and store.
+ *
+ * @param counter What to add to.
+ * @param value   How much to add.
+ */
+void stats_add(StatCounter counter, uint64_t value = 1);
+
+/**
+ * Record a time.
+ *
+ * @param histogram What was timed.
+ * @param time      How long it took.
+ */
+void stats_record(StatHistogram histogram, std::chrono::nanoseconds time);
+
+/**
+ * Record how long a command took.
+ *
+ * @param index The command's index, as given to stats_set_commands.
+ * @param time  How long it took.
+ */
+void stats_record_command(size_t index, std::chrono::nanoseconds time);
+
+/**
+ * Add up the statistics of every thread, past and present, and render them one per line.
+ *
+ * @param out Where the report is appended.
+ */
+void stats_report(std::string &out);
+
+/*---------------------------------------------------------------------
+  -- global variables
+  ---------------------------------------------------------------------*/
+
+/*---------------------------------------------------------------------
+  -- local variables
+  ---------------------------------------------------------------------*/
+
+/*---------------------------------------------------------------------
+  -- private functions
+  ---------------------------------------------------------------------*/
+
+/*---------------------------------------------------------------------
+  -- public functions
+  ---------------------------------------------------------------------*/
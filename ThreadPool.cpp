@@ -0,0 +1,190 @@
+/* ********************************************************************
+   * Project   : Thread pool
+   * Author    : Simon Martin
+   * Copyright : LGPL v3
+   ********************************************************************
+
+    Modifications:
+    0.01 14/10/2026 Initial version.
+*/
+
+/*---------------------------------------------------------------------
+  -- compatibility
+  ---------------------------------------------------------------------*/
+
+/*---------------------------------------------------------------------
+  -- project includes (import)
+  ---------------------------------------------------------------------*/
+
+/*---------------------------------------------------------------------
+  -- project includes (export)
+  ---------------------------------------------------------------------*/
+#include "ThreadPool.h"
+
+/*---------------------------------------------------------------------
+  -- C standard includes
+  ---------------------------------------------------------------------*/
+
+/*---------------------------------------------------------------------
+  -- C++ standard includes
+  ---------------------------------------------------------------------*/
+#include <algorithm>
+
+/*---------------------------------------------------------------------
+  -- macros
+  ---------------------------------------------------------------------*/
+
+/*---------------------------------------------------------------------
+  -- forward declarations
+  ---------------------------------------------------------------------*/
+
+/*---------------------------------------------------------------------
+  -- data types
+  ---------------------------------------------------------------------*/
+
+/*---------------------------------------------------------------------
+  -- function prototypes
+  ---------------------------------------------------------------------*/
+
+/*---------------------------------------------------------------------
+  -- global variables
+  ---------------------------------------------------------------------*/
+
+/*---------------------------------------------------------------------
+  -- local variables
+  ---------------------------------------------------------------------*/
+
+/*---------------------------------------------------------------------
+  -- private functions
+  ---------------------------------------------------------------------*/
+
+/*---------------------------------------------------------------------
+  -- public functions
+  ---------------------------------------------------------------------*/
+
+ThreadPool::ThreadPool(unsigned int size, size_t queue_limit) : queue_limit(queue_limit)
+{
+    for (unsigned int i = 0; i < std::max(size, 1U); i++)
+    {
+        threads.emplace_back(&ThreadPool::Worker, this);
+    }
+}
+
+ThreadPool::~ThreadPool()
+{
+    Stop();
+}
+
+void ThreadPool::Worker()
+{
+    while (true)
+    {
+        std::function<void()> task;
+
+        // Wait for something to do
+        {
+            std::unique_lock lock(tasks_mutex);
+            tasks_cv.wait(lock, [this] { return stopping || !tasks.empty(); });
+
+            // Only leave once the queue has been drained
+            if (tasks.empty())
+            {
+                return;
+            }
+            task = std::move(tasks.front());
+            tasks.pop_front();
+            running++;
+        }
+
+        // Run it without holding the lock
+        task();
+        std::lock_guard lock(tasks_mutex);
+        running--;
+    }
+}
+
+bool ThreadPool::Submit(std::function<void()> task)
+{
+    {
+        // What is queued either goes to a free thread or waits, and only so many may wait
+        std::lock_guard lock(tasks_mutex);
+        size_t idle = threads.size() - std::min(running, threads.size());
+        if (tasks.size() >= idle && tasks.size() - idle >= queue_limit)
+        {
+            return false;
+        }
+        tasks.push_back(std::move(task));
+    }
+    tasks_cv.notify_one();
+    return true;
+}
+
+void ThreadPool::Stop()
+{
+    {
+        std::lock_guard lock(tasks_mutex);
+        stopping = true;
+    }
+    tasks_cv.notify_all();
+
+    for (auto &thread : threads)
+    {
+        if (thread.joinable())
+        {
+            thread.join();
+        }
+    }
+}
+
+ThreadRegistry::~ThreadRegistry()
+{
+    Wait();
+}
+
+size_t ThreadRegistry::Size()
+{
+    std::lock_guard lock(threads_mutex);
+    return running.size();
+}
+
+void ThreadRegistry::Start(std::function<void()> task)
+{
+    // The thread cannot finish before it has been stored, as it needs the lock to move itself
+    std::lock_guard lock(threads_mutex);
+    auto position = running.emplace(running.end());
+    *position = std::thread([this, position, task = std::move(task)] {
+        task();
+
+        // Move ourselves to the finished list to be joined
+        {
+            std::lock_guard lock(threads_mutex);
+            finished.push_back(std::move(*position));
+            running.erase(position);
+        }
+        threads_cv.notify_all();
+    });
+}
+
+void ThreadRegistry::Reap()
+{
+    std::vector<std::thread> done;
+    {
+        std::lock_guard lock(threads_mutex);
+        done.swap(finished);
+    }
+
+    for (auto &thread : done)
+    {
+        thread.join();
+    }
+}
+
+void ThreadRegistry::Wait()
+{
+    {
+        std::unique_lock lock(threads_mutex);
+        threads_cv.wait(lock, [this] { return running.empty(); });
+    }
+
+    Reap();
+}
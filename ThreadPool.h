@@ -0,0 +1,168 @@
+/* ********************************************************************
+   * Project   : Thread pool
+   * Author    : Simon Martin
+   ********************************************************************
+
+    Modifications:
+    0.01 14/10/2026 Initial version.
+*/
+
+#pragma once
+
+/*---------------------------------------------------------------------
+  -- compatibility
+  ---------------------------------------------------------------------*/
+
+/*---------------------------------------------------------------------
+  -- project includes (import)
+  ---------------------------------------------------------------------*/
+
+/*---------------------------------------------------------------------
+  -- project includes (export)
+  ---------------------------------------------------------------------*/
+
+/*---------------------------------------------------------------------
+  -- C standard includes
+  ---------------------------------------------------------------------*/
+
+/*---------------------------------------------------------------------
+  -- C++ standard includes
+  ---------------------------------------------------------------------*/
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <limits>
+#include <list>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/*---------------------------------------------------------------------
+  -- macros
+  ---------------------------------------------------------------------*/
+
+/*---------------------------------------------------------------------
+  -- forward declarations
+  ---------------------------------------------------------------------*/
+
+/*---------------------------------------------------------------------
+  -- data types
+  ---------------------------------------------------------------------*/
+/**
+ * A fixed number of threads running queued tasks in the order they were submitted. The queue can be
+ * bounded, so that tasks are turned away rather than left waiting for ever behind the running ones.
+ */
+class ThreadPool
+{
+protected:
+    std::vector<std::thread> threads;
+    std::deque<std::function<void()>> tasks;
+    std::mutex tasks_mutex;
+    std::condition_variable tasks_cv;
+    size_t queue_limit;  // Most tasks waiting while every thread is busy
+    size_t running{0};   // Tasks that the threads are running
+    bool stopping{false};
+
+    /**
+     * Body of each thread: run tasks until stopped and there are none left.
+     */
+    void Worker();
+
+public:
+    /**
+     * Start the threads.
+     *
+     * @param size        Number of threads, at least one is always started.
+     * @param queue_limit Most tasks that wait for a thread while every thread is busy. If not specified,
+     *                    then there is no limit.
+     */
+    explicit ThreadPool(unsigned int size, size_t queue_limit = std::numeric_limits<size_t>::max());
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool &operator=(const ThreadPool &) = delete;
+    virtual ~ThreadPool();
+
+    /**
+     * Get the number of threads.
+     *
+     * @return The number of threads in the pool.
+     */
+    [[nodiscard]] size_t Size() const { return threads.size(); };
+
+    /**
+     * Queue a task to be run by the next free thread.
+     *
+     * @param task The task to run.
+     * @return     True if it was queued, false if every thread is busy and the queue is full, and then it
+     *             is not run.
+     */
+    bool Submit(std::function<void()> task);
+
+    /**
+     * Run everything that is still queued and then wait for all the threads to finish. Called by the
+     * destructor if it has not been called before.
+     */
+    void Stop();
+};
+
+/**
+ * Keeps track of threads that each run a single task. A thread moves itself to the finished list
+ * when its task is done, so nobody has to poll the running ones to find out which have ended.
+ */
+class ThreadRegistry
+{
+protected:
+    std::list<std::thread> running;
+    std::vector<std::thread> finished;
+    std::mutex threads_mutex;
+    std::condition_variable threads_cv;
+
+public:
+    ThreadRegistry() = default;
+    ThreadRegistry(const ThreadRegistry &) = delete;
+    ThreadRegistry &operator=(const ThreadRegistry &) = delete;
+    virtual ~ThreadRegistry();
+
+    /**
+     * Get the number of threads that are still running.
+     *
+     * @return The number of running threads.
+     */
+    [[nodiscard]] size_t Size();
+
+    /**
+     * Start a thread running the task.
+     *
+     * @param task The task to run.
+     */
+    void Start(std::function<void()> task);
+
+    /**
+     * Join the threads that have finished. Only blocks for as long as they take to return.
+     */
+    void Reap();
+
+    /**
+     * Wait for all the threads to finish and join them. Called by the destructor.
+     */
+    void Wait();
+};
+
+/*---------------------------------------------------------------------
+  -- function prototypes
+  ---------------------------------------------------------------------*/
+
+/*---------------------------------------------------------------------
+  -- global variables
+  ---------------------------------------------------------------------*/
+
+/*---------------------------------------------------------------------
+  -- local variables
+  ---------------------------------------------------------------------*/
+
+/*---------------------------------------------------------------------
+  -- private functions
+  ---------------------------------------------------------------------*/
+
+/*---------------------------------------------------------------------
+  -- public functions
+  ---------------------------------------------------------------------*/
@@ -6,11 +6,22 @@
 /*---------------------------------------------------------------------
   -- compatibility
   ---------------------------------------------------------------------*/
+#if defined(__linux__) || defined(__FreeBSD__) || defined(__NetBSD__) || defined(__OpenBSD__) || defined(__DragonFly__)
+#define HAVE_ACCEPT4 1
+#endif
+#if defined(__linux__)
+#define HAVE_THREAD_AFFINITY 1
+#endif
 
 /*---------------------------------------------------------------------
   -- project includes (import)
   ---------------------------------------------------------------------*/
 #include "CommandLine.h"
+#include "CommandRegistry.h"
+#include "EventLoop.h"
+#include "Log.h"
+#include "Stats.h"
+#include "ThreadPool.h"
 
 /*---------------------------------------------------------------------
   -- project includes (export)
@@ -24,8 +35,12 @@
 #include <netdb.h>
 #ifdef _MSC_VER
 #else
-#include <sys/syscall.h>
 #include <unistd.h>
+#include <fcntl.h>
+#endif
+#ifdef HAVE_THREAD_AFFINITY
+#include <pthread.h>
+#include <sched.h>
 #endif
 
 /*---------------------------------------------------------------------
@@ -35,24 +50,45 @@
 #include <iostream>
 #include <sstream>
 #include <array>
-#include <mutex>
+#include <iterator>
 #include <cstring>
 #include <vector>
-#include <future>
-#include <source_location>
 #include <format>
 #include <chrono>
-#include <map>
+#include <unordered_map>
+#include <thread>
+#include <limits>
+#include <list>
+#include <deque>
+#include <optional>
+#include <memory>
+#include <mutex>
 
 /*---------------------------------------------------------------------
   -- macros
   ---------------------------------------------------------------------*/
-#define WRITE_LOG(format, ...) write_log(std::source_location(), false, true, format, std::make_format_args(__VA_ARGS__))
-#define WRITE_LOG_NO_LF(format, ...) write_log(std::source_location(), false, false, format, std::make_format_args(__VA_ARGS__))
-#define WRITE_LOG_LF_BEFORE(format, ...) write_log(std::source_location(), true, true, format, std::make_format_args(__VA_ARGS__))
-
-#define DEFAULT_IP INADDR_ANY
 #define DEFAULT_PORT 8023
+#define DEFAULT_BACKLOG SOMAXCONN
+#define DEFAULT_RECV_BUFFER 16384
+#define DEFAULT_MAX_LINE 4096
+#define DEFAULT_PIPELINE 64
+#define DEFAULT_EXECUTORS 2
+#define ENVIRONMENT_PREFIX "CLI_" // What the environment variables that give options start with
+
+#define ACCEPT_BATCH 16 // Most connections a reactor takes per wake up, so that the others get a share
+#define ACCEPT_BACKOFF_MS 100 // How long accepting stops for when out of descriptors with no spare to give up
+
+#ifdef SO_REUSEPORT_LB
+#define REUSE_PORT SO_REUSEPORT_LB // FreeBSD only balances between the sockets with this one
+#elif defined(SO_REUSEPORT)
+#define REUSE_PORT SO_REUSEPORT
+#endif
+
+#ifdef MSG_NOSIGNAL
+#define SEND_FLAGS MSG_NOSIGNAL // A client that has gone away must not kill the server with SIGPIPE
+#else
+#define SEND_FLAGS 0
+#endif
 
 /*---------------------------------------------------------------------
   -- forward declarations
@@ -61,11 +97,81 @@
 /*---------------------------------------------------------------------
   -- data types
   ---------------------------------------------------------------------*/
+/**
+ * The response of a command that was run by an executor, for the connection that typed it.
+ */
+struct CommandCompletion {
+  int socket;
+  uint64_t id; // Of the session, in case the socket has been closed and reused meanwhile
+  CommandOutput output;
+};
+
+/**
+ * Where the executors hand finished commands back to a reactor, which is woken up to take them.
+ */
+struct CommandCompletions {
+  EventLoopWakeup wakeup;
+  std::mutex mutex;
+  std::vector<CommandCompletion> completed;
+};
+
+/**
+ * A complete line waiting to be run.
+ */
+struct PendingLine {
+  size_t size;
+  size_t echoed; // Characters that were echoed as they arrived
+  bool overflow; // The line was longer than allowed
+};
+
+/**
+ * State of a connection.
+ */
+struct Session {
+  int socket;
+  uint64_t id; // Unique within the reactor
+  std::string line;
+  size_t echoed; // Characters of the line that have been echoed
+  std::string pending; // Complete lines waiting to be run, one after the other
+  size_t pending_start; // Where the first of them starts
+  std::deque<PendingLine> pending_lines;
+  std::string output; // Echo, responses and prompts waiting to be sent
+  std::chrono::steady_clock::time_point last_activity;
+  std::chrono::steady_clock::time_point opened;
+  std::list<int>::iterator idle_position;
+  CommandCompletions *completions; // Where blocking commands send their responses, nullptr to run them in place
+  bool busy; // A command is being run by an executor, so the lines after it wait
+  bool reading; // Watching for input, which stops while blocked or busy
+  bool blocked; // Waiting for the client to take the output, rather than for input
+  bool hangup_seen; // The client has closed its side, which is no longer watched for
+  bool peer_closed; // Everything that the client sent before closing its side has been read
+  bool overflow; // The line is longer than allowed, so the rest of it is being dropped
+};
+
+/**
+ * An address to listen on.
+ */
+struct ListenAddress {
+  sockaddr_storage address;
+  socklen_t size;
+};
+
+/**
+ * Server wide settings taken from the command line before any connection is accepted.
+ */
+struct ServerSettings {
+  std::chrono::seconds idle_timeout{0};
+  bool echo{true};
+  size_t recv_buffer{DEFAULT_RECV_BUFFER};
+  size_t max_line{DEFAULT_MAX_LINE};
+  int max_connections{0}; // 0 means no limit
+  std::chrono::seconds stats_interval{0}; // 0 means the statistics are only shown by STATS
+  size_t pipeline{DEFAULT_PIPELINE}; // Most commands run before their responses are sent
+};
 
 /*---------------------------------------------------------------------
   -- function prototypes
   ---------------------------------------------------------------------*/
-static void write_log(std::source_location location, bool lf_before, bool lf_after, std::string_view format, std::format_args&& args);
 
 /*---------------------------------------------------------------------
   -- global variables
@@ -75,202 +181,916 @@ static void write_log(std::source_location location, bool lf_before, bool lf_aft
   -- local variables
   ---------------------------------------------------------------------*/
 static std::atomic<bool> running{true};
+static EventLoopWakeup shutdown_event;
+static ServerSettings settings;
+static std::atomic<int> connections{0};
+static CommandRegistry commands;
+static std::string help_text; // HELP's response, written once before any connection is served
+static std::optional<ThreadPool> executors;
+
+// The command line, fixed at compile time
+static constexpr std::array<CommandLineEnumName, 2> log_overflow_names{{
+    {"drop", static_cast<int64_t>(LogOverflow::Drop)},
+    {"block", static_cast<int64_t>(LogOverflow::Block)},
+}};
+static constexpr std::array<CommandLineEnumName, 3> log_format_names{{
+    {"text", static_cast<int64_t>(LogFormat::Text)},
+    {"json", static_cast<int64_t>(LogFormat::Json)},
+    {"binary", static_cast<int64_t>(LogFormat::Binary)},
+}};
+static constexpr std::array<CommandLineEnumName, 5> log_level_names{{
+    {"trace", static_cast<int64_t>(LogLevel::Trace)},
+    {"debug", static_cast<int64_t>(LogLevel::Debug)},
+    {"info", static_cast<int64_t>(LogLevel::Info)},
+    {"warn", static_cast<int64_t>(LogLevel::Warn)},
+    {"error", static_cast<int64_t>(LogLevel::Error)},
+}};
+static constexpr std::array<CommandLineOptionSpec, 24> server_options{{
+    {"host", 'h', false, HasValue::Required, Occurs::AtLeast, 1, "IP host address or name to bind to, IPv4 or IPv6. May be given more than once, and every address of each is bound. If not specified, then every local address."},
+    {"port", 'p', false, HasValue::Required, Occurs::AtMost, 1, "TCP port to bind to.", CommandLineValueType::Port()},
+    {"idle-timeout", 't', false, HasValue::Required, Occurs::AtMost, 1, "Seconds without input before a connection is closed, or a duration such as 5m, of at least a second. If not specified, then connections never time out.", CommandLineValueType::Duration(std::chrono::seconds{1}, std::chrono::seconds{1})},
+    {"no-echo", 'n', false, HasValue::No, Occurs::AtMost, 1, "Do not echo the characters received back to the client."},
+    {"recv-buffer", 'B', false, HasValue::Required, Occurs::AtMost, 1, "Size in bytes of the buffer that data is received into.", CommandLineValueType::Integer(1, std::numeric_limits<int>::max())},
+    {"max-line", 'l', false, HasValue::Required, Occurs::AtMost, 1, "Longest line in characters that a client may send. Longer lines are rejected.", CommandLineValueType::Integer(1, std::numeric_limits<int>::max())},
+    {"pipeline", 'P', false, HasValue::Required, Occurs::AtMost, 1, "Most commands received together from a client that are run before their responses are sent. If not specified, then 64.", CommandLineValueType::Integer(1, std::numeric_limits<int>::max())},
+    {"backlog", 'b', false, HasValue::Required, Occurs::AtMost, 1, "Length of the queue of connections waiting to be accepted.", CommandLineValueType::Integer(1, std::numeric_limits<int>::max())},
+    {"max-connections", 'm', false, HasValue::Required, Occurs::AtMost, 1, "Maximum number of connections at the same time, any more are turned away. If not specified, then there is no limit.", CommandLineValueType::Integer(1, std::numeric_limits<int>::max())},
+    {"log-async", 'a', false, HasValue::No, Occurs::AtMost, 1, "Write the log from a background thread, rather than from each thread as it logs."},
+    {"log-ring", '\0', false, HasValue::Required, Occurs::AtMost, 1, "Size in bytes of each thread's queue of log records when logging in the background.", CommandLineValueType::Integer(1, std::numeric_limits<int>::max())},
+    {"log-overflow", '\0', false, HasValue::Required, Occurs::AtMost, 1, "What to do with a log record when the queue is full, drop or block. If not specified, then block.", CommandLineValueType::Enum(log_overflow_names)},
+    {"log-format", '\0', false, HasValue::Required, Occurs::AtMost, 1, "How log records are written, text, json or binary. Binary logs are read back with logdecode. If not specified, then text.", CommandLineValueType::Enum(log_format_names)},
+    {"log-file", '\0', false, HasValue::Required, Occurs::AtMost, 1, "File that the log is appended to. If not specified, then standard output."},
+    {"log-mmap", '\0', false, HasValue::No, Occurs::AtMost, 1, "Write the log file through a memory mapping rather than a system call per write."},
+    {"log-level", '\0', false, HasValue::Required, Occurs::AtMost, 1, "Least important log records that are written, trace, debug, info, warn or error. If not specified, then info.", CommandLineValueType::Enum(log_level_names)},
+    {"stats-interval", 's', false, HasValue::Required, Occurs::AtMost, 1, "Seconds between writing the statistics to the log, or a duration such as 5m, of at least a second. If not specified, then they are only shown by the STATS command.", CommandLineValueType::Duration(std::chrono::seconds{1}, std::chrono::seconds{1})},
+    {"reactors", 'r', false, HasValue::Required, Occurs::AtMost, 1, "Number of event loop threads. If not specified, then connections are handled by threads, see workers.", CommandLineValueType::Integer(1, std::numeric_limits<int>::max())},
+    {"reuse-port", '\0', false, HasValue::No, Occurs::AtMost, 1, "Give each reactor its own listening socket on the same port, and let the kernel share the connections out between them."},
+    {"pin-cpus", '\0', false, HasValue::No, Occurs::AtMost, 1, "Pin each reactor to its own CPU."},
+    {"executors", 'e', false, HasValue::Required, Occurs::AtMost, 1, "Number of threads that run the commands that may take a while, so that they do not hold up the other connections of a reactor. If not specified, then 2.", CommandLineValueType::Integer(1, std::numeric_limits<int>::max())},
+    {"workers", 'w', false, HasValue::Required, Occurs::AtMost, 1, "Number of threads serving connections, one connection each at a time. If not specified, then each connection gets its own thread.", CommandLineValueType::Integer(1, std::numeric_limits<int>::max())},
+    {"worker-queue", 'q', false, HasValue::Required, Occurs::AtMost, 1, "Most connections that wait for a free worker, any more are turned away. If not specified, then as many as there are workers.", CommandLineValueType::Integer(0, std::numeric_limits<int>::max())},
+    {"config", 'c', false, HasValue::Required, Occurs::AtLeast, 1, "File of options, written as on the command line, for those that are given neither on the command line nor by a CLI_ environment variable such as CLI_PORT. The command line can also take the arguments in a file as @file, and an argument that starts with @ is written with @@."},
+}};
+using ServerCommandLine = StaticCommandLine<server_options>;
 
 /*---------------------------------------------------------------------
   -- private functions
   ---------------------------------------------------------------------*/
-static void write_log(
-  std::source_location location,
-  // ReSharper disable once CppDFAConstantParameter
-  const bool lf_before,
-  // ReSharper disable once CppDFAConstantParameter
-  const bool lf_after,
-  std::string_view format,
-  std::format_args&& args
-) {
-  static std::mutex log_mutex;
-
-  // We only want the file name, not the path
-  const char *file = location.file_name();
-  if (const char *p = strrchr(file, '/'))
-  {
-      file = p + 1;
-  }
-  uint32_t line = location.line();
-
-  // get the time stamp
-  std::string time_stamp;
-  {
-    std::chrono::time_point<std::chrono::utc_clock> epoch = std::chrono::utc_clock::now();
-    time_stamp = std::format("{0:%F} {0:%T%z}", epoch);
-  }
-
-  // get process identifiers
-#ifdef _MSC_VER
-  long pid = 0;
-  long tid = 0;
-#else
-  pid_t pid = getpid();
-  long tid = syscall(SYS_gettid);
-#endif
+// Position of an option in server_options, checked at compile time
+static consteval size_t server_option(std::string_view long_name) {
+  return ServerCommandLine::IndexOf(long_name);
+}
+
+static void stop() {
+  running = false;
+
+  // Wake up everybody that is waiting for I/O so they see that we are stopping
+  shutdown_event.Signal();
+}
+
+static void stats_dump() {
+  // Wake up every interval until the server stops
+  std::string report;
+  while (running) {
+    fd_set stop_fds;
+    FD_ZERO(&stop_fds);
+    FD_SET(shutdown_event.Fd(), &stop_fds);
+    struct timeval timeout{
+      .tv_sec = settings.stats_interval.count(),
+      .tv_usec = 0,
+    };
+    if (select(shutdown_event.Fd() + 1, &stop_fds, nullptr, nullptr, &timeout) != 0) {
+      continue;
+    }
 
-  // Create the function that will evaluate the header
-  std::string header_str;
-  if (pid == tid) {
-      header_str = std::format("{} [{}@{:05}:{:05}] ", time_stamp, file, line, pid);
+    // One record per line, so that each can be picked out of the log
+    report.clear();
+    stats_report(report);
+    for (size_t start = 0, end; (end = report.find('\n', start)) != std::string::npos; start = end + 1) {
+      std::string_view line = std::string_view{report}.substr(start, end - start);
+      WRITE_LOG("Stats {0}", line);
+    }
   }
-  else {
-      header_str = std::format("{} [{}@{:05}:{:05}:{:x}] ", time_stamp, file, line, pid, tid);
+}
+
+// ReSharper disable once CppParameterMayBeConstPtrOrRef
+static void ex(CommandArguments args, CommandOutput &out) {
+  (void)args;
+  (void)out;
+
+  stop();
+}
+
+static void dir(CommandArguments args, CommandOutput &out) {
+  (void)args;
+
+  out += "Directory...\n";
+}
+
+static void stats(CommandArguments args, CommandOutput &out) {
+  (void)args;
+
+  stats_report(out);
+}
+
+static void help(CommandArguments args, CommandOutput &out) {
+  (void)args;
+
+  out += help_text;
+}
+
+static void build_help() {
+  // The commands, with their help lined up after the longest name
+  size_t width = 0;
+  for (const auto &command : commands.Commands()) {
+    width = std::max(width, command.name.size());
   }
+  help_text = "Commands:\n";
+  for (const auto &command : commands.Commands()) {
+    help_text += "  ";
+    help_text += command.name;
+    help_text.append(width - command.name.size() + 2, ' ');
+    help_text += command.help;
+    help_text += '\n';
+  }
+
+  // Then the server's options, described when it was compiled
+  help_text += "\nOptions:\n";
+  help_text += ServerCommandLine::Usage();
+}
 
-  // This is required by C++20 to allow us to pass the format arguments to std::vformat
-  std::string body_str;
-  {
-    const std::format_args &my_args = std::move(args);
-    body_str = std::vformat(format, my_args);
+static void connection_command(std::string_view line, CommandOutput &out) {
+  // Unknown commands are ignored, but counted
+  auto start = std::chrono::steady_clock::now();
+  const CommandEntry *command = commands.Execute(line, out);
+  if (!command) {
+    stats_add(StatCounter::UnknownCommands);
+    return;
   }
+  stats_add(StatCounter::Commands);
+  stats_record_command(command - commands.Commands().data(), std::chrono::steady_clock::now() - start);
+}
 
-  // Log the line
-  std::lock_guard lock(log_mutex);
-  std::cout
-    // ReSharper disable once CppDFAConstantConditions
-    // ReSharper disable once CppDFAUnreachableCode
-    << (lf_before ? "\r\n" : "") // If we want a line feed before, then we print it
-    << header_str << body_str  // Print the header and body
-    <<  "\x1b[K\r" // Clear to end of line, and return to the start of the line
-    // ReSharper disable once CppDFAUnreachableCode
-    // ReSharper disable once CppDFAConstantConditions
-    << (lf_after ? "\n" : ""); // If we want a line feed after, then we print it
+static void connection_dispatch(Session &session, std::string_view line) {
+  session.busy = true;
+  executors->Submit([completions = session.completions, socket = session.socket, id = session.id, line = std::string{line}] {
+    CommandCompletion completion{.socket = socket, .id = id, .output = {}};
+    connection_command(line, completion.output);
+    {
+      std::lock_guard lock(completions->mutex);
+      completions->completed.push_back(std::move(completion));
+    }
+    completions->wakeup.Signal();
+  });
 }
 
-// ReSharper disable once CppParameterMayBeConstPtrOrRef
-static void ex(std::ostream &os) {
-  (void)os;
+static void connection_complete(Session &session, const CommandOutput &output) {
+  session.busy = false;
 
-  running = false;
+  // The same as if the command had been run in place
+  if (!output.empty()) {
+    session.output += "\r\n";
+    session.output += output;
+  }
+  session.output += "\r\n>>";
 }
 
-static void dir(std::ostream &os) {
-  os << "Directory..." << std::endl;
+static void connection_line(Session &session, const PendingLine &pending) {
+  std::string_view line = std::string_view{session.pending}.substr(session.pending_start, pending.size);
+
+  // Only now is the rest of the line echoed, so that it comes after the responses to the lines before it
+  if (settings.echo) {
+    session.output.append(line.substr(pending.echoed));
+  }
+
+  if (pending.overflow) {
+    // Too long to make sense of, so tell the client rather than running half of it
+    std::format_to(std::back_inserter(session.output), "\r\nError: line too long, at most {} characters\n", settings.max_line);
+  }
+  else if (!line.empty()) {
+    WRITE_LOG_TRACE("Command from socket {0}: {1}", session.socket, line);
+
+    // A command that may take a while is run by the executors, and its response and prompt come later
+    if (session.completions) {
+      if (const CommandEntry *command = commands.Match(line); command && command->blocking) {
+        connection_dispatch(session, line);
+        return;
+      }
+    }
+
+    // Process this line, the response goes straight into the output buffer after a new line
+    size_t response_start = session.output.size();
+    session.output += "\r\n";
+    connection_command(line, session.output);
+
+    // If there was no response then there is no need for the new line either
+    if (session.output.size() == response_start + 2) {
+      session.output.resize(response_start);
+    }
+  }
+
+  // Queue pŕompt to client
+  session.output += "\r\n>>";
+}
+
+static void connection_execute(Session &session) {
+  // Run the waiting lines in order, as many as the pipeline allows before the responses go out
+  for (size_t count = 0; count < settings.pipeline && !session.busy && !session.pending_lines.empty(); count++) {
+    connection_line(session, session.pending_lines.front());
+    session.pending_start += session.pending_lines.front().size;
+    session.pending_lines.pop_front();
+  }
+  if (!session.pending_lines.empty()) {
+    return;
+  }
+
+  // Everything has run, so the buffer can be reused from the start
+  session.pending.clear();
+  session.pending_start = 0;
+
+  // and the part of the next line that arrived meanwhile can be echoed
+  if (settings.echo && session.echoed < session.line.size()) {
+    session.output.append(session.line, session.echoed);
+    session.echoed = session.line.size();
+  }
+}
+
+static void connection_receive(Session &session, const char *data, ssize_t size) {
+  auto is_printable = [](unsigned char chr) { return chr >= ' ' && chr < 0x7f; };
+  stats_add(StatCounter::BytesIn, size);
+
+  // Process the received data a run at a time, where each run ends at a line terminator
+  const char *end = data + size;
+  const char *next_cr = nullptr;
+  const char *next_lf = nullptr;
+  for (const char *p = data; p < end;) {
+    // Find the next terminator, only searching again once we have gone past the last one found
+    if (next_cr < p) {
+      next_cr = static_cast<const char *>(memchr(p, '\r', end - p));
+      next_cr = next_cr ? next_cr : end;
+    }
+    if (next_lf < p) {
+      next_lf = static_cast<const char *>(memchr(p, '\n', end - p));
+      next_lf = next_lf ? next_lf : end;
+    }
+    const char *terminator = std::min(next_cr, next_lf);
+
+    // Accumulate the printable characters in blocks and dump special characters
+    while (p < terminator) {
+      const char *special = std::find_if_not(p, terminator, is_printable);
+      size_t room = settings.max_line - session.line.size();
+      size_t length = std::min(static_cast<size_t>(special - p), room);
+      if (length < static_cast<size_t>(special - p)) {
+        session.overflow = true;
+      }
+      session.line.append(p, length);
+      p = std::find_if(special, terminator, is_printable);
+    }
+
+    // Echo straight away unless there are lines still to run, whose responses must come first
+    if (settings.echo && session.pending_lines.empty()) {
+      session.output.append(session.line, session.echoed);
+      session.echoed = session.line.size();
+    }
+
+    // If this is a line terminator then we have a complete line to queue
+    if (terminator < end) {
+      session.pending_lines.push_back({.size = session.line.size(), .echoed = session.echoed, .overflow = session.overflow});
+      session.pending += session.line;
+      session.line.clear();
+      session.echoed = 0;
+      session.overflow = false;
+      p = terminator + 1;
+    }
+  }
 }
 
-static std::string &toupper(std::string &str) {
-  std::ranges::transform(
-    str,
-    str.begin(),
-    [](unsigned char chr) { return std::toupper(chr); }
-  );
+static bool connection_flush(Session &session) {
+  // Send as much as the socket will take in one go
+  size_t sent = 0;
+  while (sent < session.output.size()) {
+    ssize_t bytes_sent = send(session.socket, session.output.data() + sent, session.output.size() - sent, SEND_FLAGS);
+    if (bytes_sent == -1) {
+      if (errno == EINTR) {
+        continue;
+      }
 
-  return str;
+      // The socket is full, so keep the rest for later
+      if (errno == EAGAIN || errno == EWOULDBLOCK) {
+        break;
+      }
+
+      std::string_view error_message = strerror(errno);
+      WRITE_LOG_ERROR("Failed to send data: {0} {1}", errno, error_message);
+      stats_add(StatCounter::SendErrors);
+      session.output.clear();
+      return false;
+    }
+    sent += bytes_sent;
+  }
+
+  // Keep whatever did not go
+  stats_add(StatCounter::BytesOut, sent);
+  session.output.erase(0, sent);
+  return true;
 }
 
-static void connection_command(std::string &line, std::ostream &os) {
-  static std::map<std::string_view, std::function<void(std::ostream &os)>> tokens {
-    { "EX", ex },
-    { "DIR", dir },
-  };
+static int connection_accept(int s, bool non_blocking) {
+#ifdef HAVE_ACCEPT4
+  // Set the flags in the same system call
+  return accept4(s, nullptr, nullptr, SOCK_CLOEXEC | (non_blocking ? SOCK_NONBLOCK : 0));
+#else
+  int client_socket = accept(s, nullptr, nullptr);
+  if (client_socket == -1) {
+    return -1;
+  }
+
+  // Some systems inherit O_NONBLOCK from the listening socket, so always set it explicitly
+  int flags = fcntl(client_socket, F_GETFL);
+  if (fcntl(client_socket, F_SETFL, non_blocking ? flags | O_NONBLOCK : flags & ~O_NONBLOCK) == -1 || fcntl(client_socket, F_SETFD, FD_CLOEXEC) == -1) {
+    int error = errno;
+    close(client_socket);
+    errno = error;
+    return -1;
+  }
+  return client_socket;
+#endif
+}
 
-  char *tmp_ptr{nullptr};
-  const char *token = strtok_r(line.data(), " ", &tmp_ptr);
-  while (token) {
-    // Copy the token out to where we can process it
-    std::string token_str{token};
-    toupper(token_str);
+static bool connection_shed(int s, int &spare_fd) {
+  // Out of descriptors the connection stays queued, so the listener stays readable and the loop would spin on
+  // it. Give up the spare descriptor for long enough to take the connection and turn it away
+  bool shed = (errno == EMFILE || errno == ENFILE) && spare_fd != -1;
+  if (!shed) {
+    return false;
+  }
+  close(spare_fd);
+  int client_socket = connection_accept(s, true);
+  int error = errno;
+  if (client_socket != -1) {
+    close(client_socket);
+    stats_add(StatCounter::ConnectionsRejected);
+    WRITE_LOG_WARN("Connection rejected, out of file descriptors");
+  }
+  spare_fd = open("/dev/null", O_RDONLY | O_CLOEXEC);
+  errno = error;
+  return client_socket != -1;
+}
 
-    // If this token exists then call it
-    if (auto this_token = tokens.find(token_str); this_token != tokens.end())
-      this_token->second(os);
+static void connection_refuse(int s) {
+  // Turn it away straight away rather than making everybody else slower
+  connections--;
+  stats_add(StatCounter::ConnectionsRejected);
+  static constexpr std::string_view busy{"Too many connections\r\n"};
+  send(s, busy.data(), busy.size(), SEND_FLAGS | MSG_DONTWAIT);
+  close(s);
+}
 
-    // Carry on tokenising
-    token = strtok_r(nullptr, " ", &tmp_ptr);
+static bool connection_admit(int s) {
+  // Count it first, so that concurrent acceptors cannot both take the last slot. It is only counted as
+  // accepted once it has somewhere to go
+  if (connections.fetch_add(1) < settings.max_connections || !settings.max_connections) {
+    return true;
   }
+  connection_refuse(s);
+  WRITE_LOG_WARN("Connection rejected, limit of {0} reached", settings.max_connections);
+  return false;
+}
+
+static void connection_release() {
+  connections--;
+  stats_add(StatCounter::ConnectionsClosed);
 }
 
 static void connection(int s) {
+  Session session{.socket = s, .id = 0, .line = {}, .echoed = 0, .pending = {}, .pending_start = 0, .pending_lines = {}, .output = ">>", .last_activity = {}, .opened = std::chrono::steady_clock::now(), .idle_position = {}, .completions = nullptr, .busy = false, .reading = true, .blocked = false, .hangup_seen = false, .peer_closed = false, .overflow = false};
+  WRITE_LOG_DEBUG("Connection on socket {0}", s);
+
   // Print prompt
-  send(s, ">>", 2, 0);
+  bool connected = connection_flush(session);
 
   // Run until stopped
-  std::string line;
-  std::array<char, 256> buffer{};
+  std::vector<char> buffer(settings.recv_buffer);
   std::string_view error_message;
-  while (running) {
-    // Wait for data
+  while (running && connected) {
+    // Wait for data, or for the server to stop
     fd_set recv_fds;
     FD_ZERO(&recv_fds);
     FD_SET(s, &recv_fds);
+    FD_SET(shutdown_event.Fd(), &recv_fds);
     struct timeval timeout{
-      .tv_sec = 0,
-      .tv_usec = 100,
+      .tv_sec = settings.idle_timeout.count(),
+      .tv_usec = 0,
     };
-    switch (select(s + 1, &recv_fds, nullptr, nullptr, &timeout)) {
+    switch (select(std::max(s, shutdown_event.Fd()) + 1, &recv_fds, nullptr, nullptr, settings.idle_timeout.count() ? &timeout : nullptr)) {
       case -1:
+        if (errno == EINTR) {
+          break;
+        }
         error_message = strerror(errno);
-        WRITE_LOG("Failed to select on socket: {0} {1}", errno, error_message);
-        running = false;
+        WRITE_LOG_ERROR("Failed to select on socket: {0} {1}", errno, error_message);
+        stats_add(StatCounter::WaitErrors);
+        connected = false;
         break;
       case 0:
-        // Timeout, so just wait again
+        // Nothing received for too long
+        WRITE_LOG("Connection idle timeout");
+        stats_add(StatCounter::IdleTimeouts);
+        connected = false;
         break;
       default:
+        // If we are stopping then the loop condition takes care of it
+        if (!FD_ISSET(s, &recv_fds)) {
+          break;
+        }
+
         // We have data to read, so read it
         ssize_t bytes_received = recv(s, buffer.data(), buffer.size(), 0);
 
         // If we couldn't receive then abort
         if (bytes_received == -1) {
           error_message = strerror(errno);
-          WRITE_LOG("Failed to receive data: {0} {1}", errno, error_message);
-          running = false;
+          WRITE_LOG_ERROR("Failed to receive data: {0} {1}", errno, error_message);
+          stats_add(StatCounter::RecvErrors);
+          connected = false;
           break;
         }
 
         // If the client closed the connection then abort
         if (bytes_received == 0) {
           WRITE_LOG("Connection closed by client");
-          running = false;
+          connected = false;
           break;
         }
 
-        // Process the received data.
-        for (int i = 0; i < bytes_received; i++) {
-          // Get this character
-          char chr = buffer[i];
-
-          // If this is a line terminator then we have a line to process
-          if (chr == '\r' || chr == '\n') {
-            if (!line.empty()) {
-              // Process this line
-              std::stringstream os;
-              connection_command(line, os);
-
-              // Send the response to the client
-              std::string response = os.str();
-              if (!response.empty()) {
-                send(s, "\r\n", 2, 0);
-                send(s, response.c_str(), response.size(), 0);
-              }
+        // Process the received data, sending back everything that each batch of lines produced at once
+        connection_receive(session, buffer.data(), bytes_received);
+        do {
+          connection_execute(session);
+          connected = connection_flush(session);
+        } while (connected && !session.pending_lines.empty());
+        break;
+    }
+  }
 
-              // Line has been processed
-              line.clear();
-            }
+  stats_record(StatHistogram::Connection, std::chrono::steady_clock::now() - session.opened);
+}
+
+static bool listener_resolve(const char *host, const std::string &port, std::vector<ListenAddress> &addresses) {
+  // Without a host we listen on every local address, both IPv4 and IPv6
+  addrinfo hints{};
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  hints.ai_flags = AI_PASSIVE | AI_NUMERICSERV;
+
+  // Addresses are taken as they are, only names need the resolver
+  addrinfo *results = nullptr;
+  hints.ai_flags |= AI_NUMERICHOST;
+  int error = getaddrinfo(host, port.c_str(), &hints, &results);
+  if (error == EAI_NONAME && host) {
+    hints.ai_flags &= ~AI_NUMERICHOST;
+    error = getaddrinfo(host, port.c_str(), &hints, &results);
+  }
+  if (error) {
+    std::string_view host_name = host ? host : "*";
+    std::string_view error_message = gai_strerror(error);
+    WRITE_LOG_ERROR("Failed to resolve host {0}: {1} {2}", host_name, error, error_message);
+    return false;
+  }
+
+  // The same address can come back more than once, and from more than one host name
+  for (const addrinfo *result = results; result; result = result->ai_next) {
+    if (result->ai_family != AF_INET && result->ai_family != AF_INET6) {
+      continue;
+    }
+    ListenAddress address{.address = {}, .size = result->ai_addrlen};
+    memcpy(&address.address, result->ai_addr, result->ai_addrlen);
+    if (std::ranges::none_of(addresses, [&address](const ListenAddress &other) { return other.size == address.size && !memcmp(&other.address, &address.address, address.size); })) {
+      addresses.push_back(address);
+    }
+  }
+  freeaddrinfo(results);
+  return true;
+}
+
+static int listener_open(const ListenAddress &address, int backlog, bool reuse_port) {
+  // Create a socket and bind it to the specified host and port
+  int s = socket(address.address.ss_family, SOCK_STREAM, 0);
+  if (s == -1) {
+    std::string_view error_message = strerror(errno);
+    WRITE_LOG_ERROR("Failed to create socket: {0} {1}", errno, error_message);
+    return -1;
+  }
+
+  // IPv4 gets its own socket, so an IPv6 one must not claim the IPv4 addresses as well
+  int one = 1;
+  if (address.address.ss_family == AF_INET6 && setsockopt(s, IPPROTO_IPV6, IPV6_V6ONLY, &one, sizeof(one)) == -1) {
+    std::string_view error_message = strerror(errno);
+    WRITE_LOG_ERROR("Failed to make socket IPv6 only: {0} {1}", errno, error_message);
+    close(s);
+    return -1;
+  }
+
+  // Sharing the port lets every reactor have its own socket, and the kernel spreads the connections between them
+#ifdef REUSE_PORT
+  if (reuse_port && setsockopt(s, SOL_SOCKET, REUSE_PORT, &one, sizeof(one)) == -1) {
+    std::string_view error_message = strerror(errno);
+    WRITE_LOG_ERROR("Failed to share port: {0} {1}", errno, error_message);
+    close(s);
+    return -1;
+  }
+#else
+  (void)reuse_port;
+#endif
+
+  // Bind the socket to the specified host and port
+  std::array<char, NI_MAXHOST> host{};
+  std::array<char, NI_MAXSERV> port{};
+  getnameinfo(reinterpret_cast<const sockaddr *>(&address.address), address.size, host.data(), host.size(), port.data(), port.size(), NI_NUMERICHOST | NI_NUMERICSERV);
+  std::string_view host_name = host.data();
+  std::string_view port_name = port.data();
+  if (bind(s, reinterpret_cast<const sockaddr *>(&address.address), address.size) == -1) {
+    std::string_view error_message = strerror(errno);
+    WRITE_LOG_ERROR("Failed to bind socket to [{0}]:{1}: {2} {3}", host_name, port_name, errno, error_message);
+    close(s);
+    return -1;
+  }
+
+  // Listen for incoming connections
+  if (listen(s, backlog) == -1) {
+    std::string_view error_message = strerror(errno);
+    WRITE_LOG_ERROR("Failed to listen on socket: {0} {1}", errno, error_message);
+    close(s);
+    return -1;
+  }
+
+  // Connections are accepted until there are none left, and reactors race for them, so accept must not block
+  if (fcntl(s, F_SETFL, fcntl(s, F_GETFL) | O_NONBLOCK) == -1) {
+    std::string_view error_message = strerror(errno);
+    WRITE_LOG_ERROR("Failed to make socket non blocking: {0} {1}", errno, error_message);
+    close(s);
+    return -1;
+  }
+
+  WRITE_LOG_DEBUG("Listening on [{0}]:{1}", host_name, port_name);
+  return s;
+}
+
+static std::vector<int> allowed_cpus() {
+  // The CPUs that this process may run on, in order
+  std::vector<int> cpus;
+#ifdef HAVE_THREAD_AFFINITY
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  if (sched_getaffinity(0, sizeof(set), &set) == 0) {
+    for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+      if (CPU_ISSET(cpu, &set)) {
+        cpus.push_back(cpu);
+      }
+    }
+  }
+#endif
+  return cpus;
+}
+
+static void pin_to_cpu(int cpu) {
+#ifdef HAVE_THREAD_AFFINITY
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  CPU_SET(cpu, &set);
+  if (int error = pthread_setaffinity_np(pthread_self(), sizeof(set), &set); error) {
+    std::string_view error_message = strerror(error);
+    WRITE_LOG_WARN("Failed to pin thread to CPU {0}: {1} {2}", cpu, error, error_message);
+    return;
+  }
+  WRITE_LOG_DEBUG("Pinned thread to CPU {0}", cpu);
+#else
+  (void)cpu;
+#endif
+}
+
+static void reactor_close(EventLoop &loop, std::unordered_map<int, Session> &sessions, std::list<int> &idle_order, int s) {
+  if (auto session = sessions.find(s); session != sessions.end()) {
+    stats_record(StatHistogram::Connection, std::chrono::steady_clock::now() - session->second.opened);
+    idle_order.erase(session->second.idle_position);
+    sessions.erase(session);
+    connection_release();
+  }
+  loop.Remove(s);
+  close(s);
+}
 
-            // Send pŕompt to client
-            send(s, "\r\n>>", 4, 0);
+static bool reactor_flush(EventLoop &loop, Session &session) {
+  // While a command is out with the executors hold back its echo, so that it goes out with the response
+  if (!session.busy && !connection_flush(session)) {
+    return false;
+  }
+
+  // Stop reading while the client is not taking what we send, and wait until it can take more. Also stop
+  // while a command is out with the executors, so that lines do not pile up behind it
+  bool blocked = !session.busy && !session.output.empty();
+  bool reading = !blocked && !session.busy && !session.peer_closed;
+  if (blocked != session.blocked || reading != session.reading) {
+    session.blocked = blocked;
+    session.reading = reading;
+    return loop.Modify(session.socket, reading, blocked, !session.hangup_seen);
+  }
+  return true;
+}
+
+static bool reactor_hangup(EventLoop &loop, Session &session, bool input_ended) {
+  // The hang up has been seen, so stop watching for it. What was sent before it is still read, until the end
+  session.hangup_seen = true;
+  if (input_ended) {
+    session.peer_closed = true;
+    session.reading = false;
+  }
+  return loop.Modify(session.socket, session.reading, session.blocked, false);
+}
+
+static bool reactor_done(const Session &session) {
+  // A client that has closed its side still gets the answers to everything that it sent before it did
+  return session.peer_closed && !session.busy && session.pending_lines.empty() && session.output.empty();
+}
+
+static bool reactor_run(EventLoop &loop, Session &session) {
+  // Run the waiting lines a batch at a time, leaving the rest for when the client has taken the output
+  do {
+    connection_execute(session);
+    if (!reactor_flush(loop, session)) {
+      return false;
+    }
+  } while (!session.blocked && !session.busy && !session.pending_lines.empty());
+  return true;
+}
+
+static int reactor_timeout(const std::unordered_map<int, Session> &sessions, const std::list<int> &idle_order, std::chrono::steady_clock::time_point accept_resume) {
+  // Wake up to accept again, if that has stopped. The least recently active session is always at the front
+  auto deadline = accept_resume;
+  if (settings.idle_timeout.count() && !idle_order.empty()) {
+    deadline = std::min(deadline, sessions.at(idle_order.front()).last_activity + settings.idle_timeout);
+  }
+
+  // Without either there is nothing to wake up for
+  if (deadline == std::chrono::steady_clock::time_point::max()) {
+    return -1;
+  }
+  auto remaining = std::chrono::ceil<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now());
+  return static_cast<int>(std::max<std::chrono::milliseconds::rep>(remaining.count(), 0));
+}
+
+static void reactor(std::vector<int> listen_sockets, bool shared, int cpu, CommandCompletions *completions) {
+  // Keep to one core, so that its connections stay in that core's caches
+  if (cpu != -1) {
+    pin_to_cpu(cpu);
+  }
+
+  std::string_view backend = EventLoop::Backend();
+  EventLoop loop;
+  if (!loop.IsOpen()) {
+    std::string_view error_message = strerror(errno);
+    WRITE_LOG_ERROR("Failed to create {0} event loop: {1} {2}", backend, errno, error_message);
+    return;
+  }
+
+  // A shared listening socket is watched by every reactor, so whoever wins the accept owns the connection
+  for (int listen_socket : listen_sockets) {
+    if (!loop.Add(listen_socket, shared)) {
+      std::string_view error_message = strerror(errno);
+      WRITE_LOG_ERROR("Failed to watch listening socket: {0} {1}", errno, error_message);
+      return;
+    }
+  }
+  if (!loop.Add(shutdown_event.Fd())) {
+    std::string_view error_message = strerror(errno);
+    WRITE_LOG_ERROR("Failed to watch shutdown event: {0} {1}", errno, error_message);
+    return;
+  }
+  if (!loop.Add(completions->wakeup.Fd())) {
+    std::string_view error_message = strerror(errno);
+    WRITE_LOG_ERROR("Failed to watch command completions: {0} {1}", errno, error_message);
+    return;
+  }
+
+  // Run until stopped
+  std::unordered_map<int, Session> sessions;
+  std::list<int> idle_order; // Least recently active first
+  std::vector<EventLoopEvent> events;
+  std::vector<char> buffer(settings.recv_buffer);
+  std::vector<CommandCompletion> completed;
+  uint64_t next_id = 0;
+  int spare_fd = open("/dev/null", O_RDONLY | O_CLOEXEC); // Given up to turn connections away when out of descriptors
+  auto accept_resume = std::chrono::steady_clock::time_point::max(); // When to watch the listeners again, if not now
+  while (running) {
+    // Wait for something to happen, for the oldest connection to go idle or to accept again
+    if (loop.Wait(events, reactor_timeout(sessions, idle_order, accept_resume)) == -1) {
+      if (errno == EINTR) {
+        continue;
+      }
+      std::string_view error_message = strerror(errno);
+      WRITE_LOG_ERROR("Failed to wait on {0} event loop: {1} {2}", backend, errno, error_message);
+      stats_add(StatCounter::WaitErrors);
+      break;
+    }
+
+    // Drop the connections that have been quiet for too long
+    auto now = std::chrono::steady_clock::now();
+    while (settings.idle_timeout.count() && !idle_order.empty() && sessions.at(idle_order.front()).last_activity + settings.idle_timeout <= now) {
+      WRITE_LOG("Connection idle timeout");
+      stats_add(StatCounter::IdleTimeouts);
+      reactor_close(loop, sessions, idle_order, idle_order.front());
+    }
+
+    // Watch the listeners again once the back off is over, and have another go at getting a spare descriptor
+    if (accept_resume <= now) {
+      accept_resume = std::chrono::steady_clock::time_point::max();
+      if (spare_fd == -1) {
+        spare_fd = open("/dev/null", O_RDONLY | O_CLOEXEC);
+      }
+      for (int listen_socket : listen_sockets) {
+        if (!loop.Add(listen_socket, shared)) {
+          std::string_view error_message = strerror(errno);
+          WRITE_LOG_ERROR("Failed to watch listening socket: {0} {1}", errno, error_message);
+        }
+      }
+    }
+
+    for (const auto &event : events) {
+      // The shutdown event stays signalled, so the loop condition takes care of it
+      if (event.fd == shutdown_event.Fd()) {
+        continue;
+      }
+
+      // Commands that the executors have finished, whose connections can carry on
+      if (event.fd == completions->wakeup.Fd()) {
+        completions->wakeup.Clear();
+        {
+          std::lock_guard lock(completions->mutex);
+          completed.swap(completions->completed);
+        }
+        for (const auto &completion : completed) {
+          auto session = sessions.find(completion.socket);
+          if (session == sessions.end() || session->second.id != completion.id) {
             continue;
           }
+          connection_complete(session->second, completion.output);
+          session->second.last_activity = now;
+          idle_order.splice(idle_order.end(), idle_order, session->second.idle_position);
+          bool open = session->second.blocked ? reactor_flush(loop, session->second) : reactor_run(loop, session->second);
+          if (!open || reactor_done(session->second)) {
+            reactor_close(loop, sessions, idle_order, completion.socket);
+          }
+        }
+        completed.clear();
+        continue;
+      }
 
-          // Dump special characters
-          if (!isprint(chr)) {
+      // New connections, take a batch of them. Losing the race to another reactor is not an error
+      if (std::ranges::find(listen_sockets, event.fd) != listen_sockets.end()) {
+        if (accept_resume != std::chrono::steady_clock::time_point::max()) {
+          continue;
+        }
+        auto accept_start = std::chrono::steady_clock::now();
+        for (int i = 0; i < ACCEPT_BATCH; i++) {
+          int client_socket;
+          if ((client_socket = connection_accept(event.fd, true)) == -1) {
+            if (connection_shed(event.fd, spare_fd)) {
+              continue;
+            }
+            bool exhausted = errno == EMFILE || errno == ENFILE;
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+              std::string_view error_message = strerror(errno);
+              WRITE_LOG_ERROR("Failed to accept connection: {0} {1}", errno, error_message);
+              stats_add(StatCounter::AcceptErrors);
+            }
+
+            // Out of descriptors with none to give up, the connections stay queued and the listeners readable.
+            // Stop watching them for a while, rather than spinning until a descriptor is freed
+            if (exhausted) {
+              for (int listen_socket : listen_sockets) {
+                loop.Remove(listen_socket);
+              }
+              accept_resume = now + std::chrono::milliseconds(ACCEPT_BACKOFF_MS);
+            }
+            break;
+          }
+          if (!connection_admit(client_socket)) {
+            continue;
+          }
+          stats_add(StatCounter::ConnectionsAccepted);
+          if (!loop.Add(client_socket)) {
+            std::string_view error_message = strerror(errno);
+            WRITE_LOG_ERROR("Failed to watch client socket: {0} {1}", errno, error_message);
+            close(client_socket);
+            connection_release();
             continue;
           }
+          auto session = sessions.emplace(client_socket, Session{
+            .socket = client_socket,
+            .id = next_id++,
+            .line = {},
+            .echoed = 0,
+            .pending = {},
+            .pending_start = 0,
+            .pending_lines = {},
+            .output = ">>",
+            .last_activity = now,
+            .opened = now,
+            .idle_position = idle_order.insert(idle_order.end(), client_socket),
+            .completions = completions,
+            .busy = false,
+            .reading = true,
+            .blocked = false,
+            .hangup_seen = false,
+            .peer_closed = false,
+            .overflow = false,
+          }).first;
+          WRITE_LOG_DEBUG("Connection on socket {0}", client_socket);
 
-          // Accumulate character
-          send(s, &chr, 1, 0);
-          line += chr;
+          // Print prompt
+          if (!reactor_flush(loop, session->second)) {
+            reactor_close(loop, sessions, idle_order, client_socket);
+          }
         }
-        break;
+        stats_record(StatHistogram::Accept, std::chrono::steady_clock::now() - accept_start);
+        continue;
+      }
+
+      // Data, or a hang up, on an existing connection
+      auto session = sessions.find(event.fd);
+      if (session == sessions.end()) {
+        continue;
+      }
+
+      // The client has made room for the rest of the output, and so for the lines that were held back
+      if (event.writable) {
+        bool open = reactor_flush(loop, session->second);
+        if (open && !session->second.blocked && !session->second.pending_lines.empty()) {
+          open = reactor_run(loop, session->second);
+        }
+        if (!open || reactor_done(session->second)) {
+          reactor_close(loop, sessions, idle_order, event.fd);
+          continue;
+        }
+      }
+
+      if (event.readable) {
+        ssize_t bytes_received = recv(event.fd, buffer.data(), buffer.size(), 0);
+
+        // If we couldn't receive then abort
+        if (bytes_received == -1) {
+          std::string_view error_message = strerror(errno);
+          WRITE_LOG_ERROR("Failed to receive data: {0} {1}", errno, error_message);
+          stats_add(StatCounter::RecvErrors);
+          reactor_close(loop, sessions, idle_order, event.fd);
+          continue;
+        }
+
+        // If the client closed its side then finish off what it sent, which may still be running
+        if (bytes_received == 0) {
+          WRITE_LOG("Connection closed by client");
+          if (!reactor_hangup(loop, session->second, true) || reactor_done(session->second)) {
+            reactor_close(loop, sessions, idle_order, event.fd);
+          }
+          continue;
+        }
+
+        // This is now the most recently active connection
+        session->second.last_activity = now;
+        idle_order.splice(idle_order.end(), idle_order, session->second.idle_position);
+
+        // Process the received data, sending back everything that each batch of lines produced at once
+        connection_receive(session->second, buffer.data(), bytes_received);
+        if (!reactor_run(loop, session->second)) {
+          reactor_close(loop, sessions, idle_order, event.fd);
+        }
+      }
+      else if (event.hangup) {
+        // Once the half close has been seen, a hang up means that the client has gone altogether. Until
+        // then, the lines that it sent are finished off when the session next reads, and reads the end
+        if (session->second.hangup_seen || !reactor_hangup(loop, session->second, false)) {
+          reactor_close(loop, sessions, idle_order, event.fd);
+        }
+      }
+    }
+  }
+
+  // Close whatever is still open
+  if (accept_resume == std::chrono::steady_clock::time_point::max()) {
+    for (int listen_socket : listen_sockets) {
+      loop.Remove(listen_socket);
     }
   }
+  loop.Remove(shutdown_event.Fd());
+  loop.Remove(completions->wakeup.Fd());
+  for (const auto &session : sessions) {
+    loop.Remove(session.first);
+    close(session.first);
+    connection_release();
+  }
+  if (spare_fd != -1) {
+    close(spare_fd);
+  }
 }
 
 /*---------------------------------------------------------------------
@@ -278,135 +1098,323 @@ static void connection(int s) {
   ---------------------------------------------------------------------*/
 
 int main(int argc, char *argv[]) {
-  int s{-1};
-  std::vector<std::future<void>> threads;
-
-  WRITE_LOG("Hello");
+  std::vector<int> listeners;
+  ThreadRegistry threads;
+  std::optional<ThreadPool> workers;
+  std::vector<std::unique_ptr<CommandCompletions>> completions; // One for each reactor, outliving the executors
+  std::thread stats_thread;
 
   // Simplify error handling
   do {
     // Get the parameters
-    CommandLine cmd_run;
-    cmd_run.AddOption("host", 'h', false, HasValue::Required, Occurs::AtMost, 1, "IP host address to bind to.");
-    cmd_run.AddOption("port", 'p', false, HasValue::Required, Occurs::AtMost, 1, "TCP port to bind to.");
-
+    ServerCommandLine cmd_run;
+    cmd_run.SetEnvironmentPrefix(ENVIRONMENT_PREFIX);
+    cmd_run.SetConfigOption<server_option("config")>();
     if (std::stringstream error_message; !cmd_run.Parse(argc, argv, error_message)) {
       std::cerr << error_message.str() << std::endl;
       cmd_run.PrintUsage(argv);
       break;
     }
+    int port_number = DEFAULT_PORT;
+    cmd_run.GetOptionValue<server_option("port")>(port_number);
+    cmd_run.GetOptionValue<server_option("idle-timeout")>(settings.idle_timeout);
+    settings.echo = !cmd_run.IsOptionValue<server_option("no-echo")>();
+    int reactors = 0;
+    cmd_run.GetOptionValue<server_option("reactors")>(reactors);
+    cmd_run.GetOptionValue<server_option("recv-buffer")>(settings.recv_buffer);
+    cmd_run.GetOptionValue<server_option("max-line")>(settings.max_line);
+    cmd_run.GetOptionValue<server_option("pipeline")>(settings.pipeline);
+    int backlog = DEFAULT_BACKLOG;
+    cmd_run.GetOptionValue<server_option("backlog")>(backlog);
+    cmd_run.GetOptionValue<server_option("max-connections")>(settings.max_connections);
+    cmd_run.GetOptionValue<server_option("stats-interval")>(settings.stats_interval);
+    bool reuse_port = cmd_run.IsOptionValue<server_option("reuse-port")>();
+    bool pin_cpus = cmd_run.IsOptionValue<server_option("pin-cpus")>();
+    if ((reuse_port || pin_cpus) && !reactors) {
+      std::cerr << "Error: options reuse-port and pin-cpus need reactors" << std::endl;
+      cmd_run.PrintUsage(argv);
+      break;
+    }
+#ifndef REUSE_PORT
+    if (reuse_port) {
+      std::cerr << "Error: option reuse-port is not supported on this system" << std::endl;
+      break;
+    }
+#endif
+#ifndef HAVE_THREAD_AFFINITY
+    if (pin_cpus) {
+      std::cerr << "Error: option pin-cpus is not supported on this system" << std::endl;
+      break;
+    }
+#endif
+    int executor_count = DEFAULT_EXECUTORS;
+    cmd_run.GetOptionValue<server_option("executors")>(executor_count);
+    if (cmd_run.IsOptionValue<server_option("executors")>() && !reactors) {
+      std::cerr << "Error: option executors needs reactors" << std::endl;
+      cmd_run.PrintUsage(argv);
+      break;
+    }
+    int worker_count = 0;
+    cmd_run.GetOptionValue<server_option("workers")>(worker_count);
+    int worker_queue = worker_count;
+    cmd_run.GetOptionValue<server_option("worker-queue")>(worker_queue);
+    if (cmd_run.IsOptionValue<server_option("worker-queue")>() && !worker_count) {
+      std::cerr << "Error: option worker-queue needs workers" << std::endl;
+      cmd_run.PrintUsage(argv);
+      break;
+    }
+
+    // Send the log where it was asked for
+    LogFormat log_format{LogFormat::Text};
+    cmd_run.GetOptionValue<server_option("log-format")>(log_format);
+    if (cmd_run.IsOptionValue<server_option("log-mmap")>() && !cmd_run.IsOptionValue<server_option("log-file")>()) {
+      std::cerr << "Error: option log-mmap needs log-file" << std::endl;
+      cmd_run.PrintUsage(argv);
+      break;
+    }
+    std::string_view log_file;
+    cmd_run.GetOptionValue<server_option("log-file")>(log_file);
+    if (!log_open(log_format, log_file, cmd_run.IsOptionValue<server_option("log-mmap")>())) {
+      std::cerr << "Error: failed to open log file " << log_file << ": " << strerror(errno) << std::endl;
+      break;
+    }
+
+    // Only log what was asked for
+    if (cmd_run.IsOptionValue<server_option("log-level")>()) {
+      LogLevel level{LogLevel::Info};
+      cmd_run.GetOptionValue<server_option("log-level")>(level);
+      log_set_level(level);
+    }
+    WRITE_LOG("Hello");
 
-    // Resolve the host name to an IP address
-    struct hostent host_buf{};
-    struct hostent *host_ptr{nullptr};
-    if (cmd_run.IsOptionValue("host")) {
-      std::array<char, 8192> tmp_buf{};
-      int gethost_errno{0};
-      if (gethostbyname_r(cmd_run.GetOptionValues("host")[0].c_str(), &host_buf, tmp_buf.data(), tmp_buf.size(), &host_ptr, &gethost_errno) != 0) {
-        std::string_view error_message = hstrerror(gethost_errno);
-        WRITE_LOG("Failed to resolve host {0}: {1} {2}", cmd_run.GetOptionValues("host")[0], gethost_errno, error_message);
+    // Move the logging out of the way of the connections
+    if (cmd_run.IsOptionValue<server_option("log-async")>()) {
+      size_t log_ring = DEFAULT_LOG_RING;
+      cmd_run.GetOptionValue<server_option("log-ring")>(log_ring);
+      LogOverflow log_overflow{LogOverflow::Block};
+      cmd_run.GetOptionValue<server_option("log-overflow")>(log_overflow);
+      if (!log_start_async(log_ring, log_overflow)) {
+        std::cerr << "Error: failed to start the log writer" << std::endl;
         break;
       }
     }
 
-    // Create a socket and bind it to the specified host and port
-    if ((s = socket(AF_INET, SOCK_STREAM, 0)) == -1) {
+    // Build the commands, they cannot change once connections are being served
+    commands.Add("EX", "Stop the server.", ex);
+    commands.Add("DIR", "List the directory.", dir, true);
+    commands.Add("STATS", "Show the server statistics.", stats);
+    commands.Add("HELP", "Show the commands and the server's options.", help);
+    commands.Freeze();
+    build_help();
+
+    // Each command is timed on its own
+    std::vector<std::string_view> command_names;
+    for (const auto &command : commands.Commands()) {
+      command_names.emplace_back(command.name);
+    }
+    stats_set_commands(command_names);
+
+    // Everybody waits on this to find out that we are stopping
+    if (!shutdown_event.IsOpen()) {
       std::string_view error_message = strerror(errno);
-      WRITE_LOG("Failed to create socket: {0} {1}", errno, error_message);
+      WRITE_LOG_ERROR("Failed to create shutdown event: {0} {1}", errno, error_message);
       break;
     }
 
-    // Bind the socket to the specified host and port
+    // Resolve the host names to addresses
+    std::vector<ListenAddress> addresses;
+    std::string port = std::to_string(port_number);
+    if (cmd_run.IsOptionValue<server_option("host")>()) {
+      // The views are the ends of arguments, so they are terminated
+      const CommandLineValueViews &hosts = cmd_run.GetOptionViews<server_option("host")>();
+      size_t resolved = 0;
+      while (resolved < hosts.Size() && listener_resolve(hosts[resolved].data(), port, addresses)) {
+        resolved++;
+      }
+      if (resolved < hosts.Size()) {
+        break;
+      }
+    }
+    else if (!listener_resolve(nullptr, port, addresses)) {
+      break;
+    }
 
-    if (sockaddr_in addr{
-          .sin_family = AF_INET,
-          .sin_port = htons(static_cast<uint16_t>(cmd_run.IsOptionValue("port") ? std::stoi(cmd_run.GetOptionValues("port")[0]) : DEFAULT_PORT)),
-          .sin_addr = host_ptr && host_ptr->h_addr_list[0] ? *reinterpret_cast<in_addr *>(host_ptr->h_addr_list[0]) : in_addr{.s_addr = DEFAULT_IP},
-          .sin_zero{0}
-        }; bind(s, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) == -1) {
-      std::string_view error_message = strerror(errno);
-      WRITE_LOG("Failed to bind socket: {0} {1}", errno, error_message);
+    // Open a listening socket for each address, or with a shared port one for each address and reactor
+    size_t listeners_per_address = reuse_port ? static_cast<size_t>(reactors) : 1;
+    size_t listener_count = addresses.size() * listeners_per_address;
+    int listener;
+    while (listeners.size() < listener_count && (listener = listener_open(addresses[listeners.size() / listeners_per_address], backlog, reuse_port)) != -1) {
+      listeners.push_back(listener);
+    }
+    if (listeners.size() < listener_count) {
       break;
     }
 
-    // Listen for incoming connections
-    if (listen(s, 5) == -1) {
-      std::string_view error_message = strerror(errno);
-      WRITE_LOG("Failed to listen on socket: {0} {1}", errno, error_message);
+    // Write the statistics out every so often
+    if (settings.stats_interval.count()) {
+      stats_thread = std::thread(stats_dump);
+    }
+
+    // In event loop mode the reactor threads accept and multiplex all the connections
+    if (reactors) {
+      std::string_view backend = EventLoop::Backend();
+      WRITE_LOG("Starting {0} {1} reactor(s), {2} listening socket(s)", reactors, backend, listener_count);
+      std::vector<int> cpus = pin_cpus ? allowed_cpus() : std::vector<int>{};
+      WRITE_LOG("Starting {0} executor(s)", executor_count);
+      executors.emplace(executor_count);
+      for (int i = 0; i < reactors; i++) {
+        completions.push_back(std::make_unique<CommandCompletions>());
+      }
+      if (std::ranges::any_of(completions, [](const auto &completion) { return !completion->wakeup.IsOpen(); })) {
+        std::string_view error_message = strerror(errno);
+        WRITE_LOG_ERROR("Failed to create command completions: {0} {1}", errno, error_message);
+        break;
+      }
+      std::vector<std::thread> reactor_threads;
+      for (int i = 0; i < reactors; i++) {
+        // Every reactor watches every address, either through the shared sockets or through its own
+        std::vector<int> reactor_listeners;
+        for (size_t address = 0; address < addresses.size(); address++) {
+          reactor_listeners.push_back(listeners[address * listeners_per_address + i % listeners_per_address]);
+        }
+        int cpu = cpus.empty() ? -1 : cpus[i % cpus.size()];
+        reactor_threads.emplace_back(reactor, std::move(reactor_listeners), listeners_per_address == 1, cpu, completions[i].get());
+      }
+      for (auto &reactor_thread : reactor_threads) {
+        reactor_thread.join();
+      }
       break;
     }
 
+    // Connections are queued to a fixed number of threads, rather than each getting its own
+    if (worker_count) {
+      WRITE_LOG("Starting {0} worker(s), {1} connection(s) may wait for one", worker_count, worker_queue);
+      workers.emplace(worker_count, worker_queue);
+    }
+
     // Run until stopped
+    int max_fd = std::max(std::ranges::max(listeners), shutdown_event.Fd());
+    int spare_fd = open("/dev/null", O_RDONLY | O_CLOEXEC); // Given up to turn connections away when out of descriptors
     while (running) {
-      // Wait for a connection
+      // Wait for a connection, or for the server to stop
       fd_set accept_fds;
       FD_ZERO(&accept_fds);
-      FD_SET(s, &accept_fds);
-      struct timeval timeout{
-        .tv_sec = 0,
-        .tv_usec = 100,
-      };
-      switch (select(s + 1, &accept_fds, nullptr, nullptr, &timeout)) {
+      for (int listener : listeners) {
+        FD_SET(listener, &accept_fds);
+      }
+      FD_SET(shutdown_event.Fd(), &accept_fds);
+      switch (select(max_fd + 1, &accept_fds, nullptr, nullptr, nullptr)) {
         case -1:
           {
+            if (errno == EINTR) {
+              continue;
+            }
             std::string_view error_message = strerror(errno);
-            WRITE_LOG("Failed to select on socket: {0} {1}", errno, error_message);
+            WRITE_LOG_ERROR("Failed to select on socket: {0} {1}", errno, error_message);
+            stats_add(StatCounter::WaitErrors);
             continue;
           }
         case 0:
-          {
-            // Timeout, so just clean up the threads and wait again{
-            auto i = std::begin(threads);
-            while (i != std::end(threads)) {
-              if (i->wait_for(std::chrono::seconds(0)) == std::future_status::ready) {
-                i->get();
-                threads.erase(i);
-              }
-            }
-          }
+          // We wait forever, so this cannot happen
           break;
         default:
-          // Accept the connection
-          int client_socket;
-          if ((client_socket = accept(s, nullptr, nullptr)) == -1) {
-            std::string_view error_message = strerror(errno);
-            WRITE_LOG("Failed to accept connection: {0} {1}", errno, error_message);
-            continue;
-          }
+          // Clean up the threads that have finished
+          threads.Reap();
+
+          // Take the connections from every socket that has them, if we are stopping then the loop condition takes care of it
+          for (int s : listeners) {
+            if (!FD_ISSET(s, &accept_fds)) {
+              continue;
+            }
+
+            // Accept everything that is waiting, each connection is handed over by value
+            auto accept_start = std::chrono::steady_clock::now();
+            int client_socket;
+            while ((client_socket = connection_accept(s, false)) != -1 || connection_shed(s, spare_fd)) {
+              // Turned away for want of descriptors, then on to the next one
+              if (client_socket == -1) {
+                continue;
+              }
+              if (!connection_admit(client_socket)) {
+                continue;
+              }
+
+              // Queue it to the next free worker. Once they are all busy and as many are waiting as may, it is
+              // turned away rather than left waiting with no prompt
+              if (workers) {
+                bool queued = workers->Submit([client_socket] {
+                  connection(client_socket);
+                  close(client_socket);
+                  connection_release();
+                });
+                if (!queued) {
+                  connection_refuse(client_socket);
+                  WRITE_LOG_WARN("Connection rejected, all {0} workers busy and {1} connection(s) waiting", worker_count, worker_queue);
+                  continue;
+                }
+                stats_add(StatCounter::ConnectionsAccepted);
+                continue;
+              }
+
+              // Start a thread to handle the connection
+              stats_add(StatCounter::ConnectionsAccepted);
+              threads.Start([client_socket] {
+                // Run the connection handler
+                connection(client_socket);
 
-          // Start a thread to handle the connection
-          std::mutex cm; // Mutex to synchronise the client socket transfer to the thread
-          std::unique_lock cl{cm}; // Lock the mutex before starting the thread to ensure that the thread waits until we have moved the client socket into it
-          std::condition_variable cv{}; // Condition variable to signal the thread that the client socket has been moved into it
-          auto future = std::async(std::launch::async, [&client_socket, &cl, &cv] {
-            // We need to move the client socket into the thread, so we will set it to -1 in the main thread to indicate that it has been moved
-            int my_socket = client_socket;
-            cl.unlock();
-            cv.notify_all();
-
-            // Run the connection handler
-            connection(my_socket);
-
-            // Close the client socket when done
-            close(my_socket);
-          });
-          threads.emplace_back(std::move(future));
-
-          // Wait for the client socket to be moved into the thread before we can continue accepting connections
-          while (cv.wait_for(cl, std::chrono::milliseconds(100)) != std::cv_status::no_timeout)
-            ;
+                // Close the client socket when done
+                close(client_socket);
+                connection_release();
+              });
+            }
+            bool exhausted = errno == EMFILE || errno == ENFILE;
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+              std::string_view error_message = strerror(errno);
+              WRITE_LOG_ERROR("Failed to accept connection: {0} {1}", errno, error_message);
+              stats_add(StatCounter::AcceptErrors);
+            }
+            stats_record(StatHistogram::Accept, std::chrono::steady_clock::now() - accept_start);
+
+            // Out of descriptors with none to give up, the listener stays readable. Wait a while, or until the
+            // server stops, rather than spinning until a descriptor is freed, then try for a spare again
+            if (exhausted) {
+              fd_set stop_fds;
+              FD_ZERO(&stop_fds);
+              FD_SET(shutdown_event.Fd(), &stop_fds);
+              struct timeval timeout{
+                .tv_sec = 0,
+                .tv_usec = ACCEPT_BACKOFF_MS * 1000,
+              };
+              select(shutdown_event.Fd() + 1, &stop_fds, nullptr, nullptr, &timeout);
+              if (spare_fd == -1) {
+                spare_fd = open("/dev/null", O_RDONLY | O_CLOEXEC);
+              }
+              break;
+            }
+          }
       }
     }
+    if (spare_fd != -1) {
+      close(spare_fd);
+    }
   } while (false);
 
-  // Wait for all threads to finish
-  for (auto &thread : threads) {
-    thread.wait();
-    thread.get();
+  // Wait for all threads to finish, making sure that they know we are stopping whatever the reason
+  stop();
+  if (stats_thread.joinable()) {
+    stats_thread.join();
+  }
+  if (workers) {
+    workers->Stop();
   }
+  if (executors) {
+    executors->Stop();
+  }
+  threads.Wait();
+  log_stop();
 
-  // Close socket
-  if (s != -1) {
-    close(s);
+  // Close the listening sockets
+  for (int listener : listeners) {
+    close(listener);
   }
 }